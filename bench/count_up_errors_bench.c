@@ -0,0 +1,174 @@
+/*
+ * Scan of intervals the way count_up_errors() does it, with entries keyed by
+ * MessageInfo as they were and by packed MessageKey. Every entry is summed
+ * into an open-addressing table by its key, so both the scan of entries and
+ * hashing of keys are measured.
+ *
+ *     cc -O2 -o count_up_errors_bench bench/count_up_errors_bench.c
+ *     ./count_up_errors_bench [intervals [entries]]
+ *
+ * Not built by PGXS, doesn't need PostgreSQL headers.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define rounds	20
+
+typedef struct message_info {
+    int error_code;
+    unsigned int db_oid;
+    unsigned int user_oid;
+    int message_type_index;
+} MessageInfo;
+
+typedef struct wide_entry {
+    MessageInfo key;
+    uint32_t counter;
+} WideEntry;
+
+typedef struct message_key {
+    uint32_t code;
+    uint32_t principal;
+} MessageKey;
+
+typedef struct packed_entry {
+    MessageKey key;
+    uint32_t counter;
+} PackedEntry;
+
+typedef struct wide_elem {
+    MessageInfo key;
+    uint32_t counter;
+    int used;
+} WideElem;
+
+typedef struct packed_elem {
+    MessageKey key;
+    uint32_t counter;
+    int used;
+} PackedElem;
+
+static uint32_t
+finish_hash(uint32_t hash)
+{
+    hash ^= hash >> 16;
+    hash *= 0x85EBCA6B;
+    hash ^= hash >> 13;
+    return hash;
+}
+
+static uint32_t
+wide_hash(const MessageInfo *key)
+{
+    uint32_t hash;
+    hash = (uint32_t) key->error_code;
+    hash = (hash * 0x9E3779B1) ^ key->db_oid;
+    hash = (hash * 0x9E3779B1) ^ key->user_oid;
+    hash = (hash * 0x9E3779B1) ^ (uint32_t) key->message_type_index;
+    return finish_hash(hash);
+}
+
+static uint32_t
+packed_hash(const MessageKey *key)
+{
+    return finish_hash((key->code * 0x9E3779B1) ^ key->principal);
+}
+
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int
+main(int argc, char **argv)
+{
+    int intervals = argc > 1 ? atoi(argv[1]) : 120;
+    int entries = argc > 2 ? atoi(argv[2]) : 512;
+    uint32_t mask;
+    WideEntry *wide;
+    PackedEntry *packed;
+    WideElem *wide_table;
+    PackedElem *packed_table;
+    uint64_t wide_sum = 0;
+    uint64_t packed_sum = 0;
+    double start;
+    double wide_time;
+    double packed_time;
+    uint32_t slot;
+    int i;
+    int r;
+
+    mask = 2;
+    while (mask < (uint32_t) entries * 2)
+        mask *= 2;
+    mask--;
+    wide = malloc(sizeof(WideEntry) * intervals * entries);
+    packed = malloc(sizeof(PackedEntry) * intervals * entries);
+    wide_table = malloc(sizeof(WideElem) * (mask + 1));
+    packed_table = malloc(sizeof(PackedElem) * (mask + 1));
+    srand(1);
+    /* Every interval has the same message kinds in another order */
+    for (i = 0; i < intervals * entries; ++i) {
+        int kind = (i % entries + i / entries * 7) % entries;
+        wide[i].key.error_code = kind % 64 + 2;
+        wide[i].key.db_oid = 16384 + kind / 64 % 4;
+        wide[i].key.user_oid = 10 + kind / 256;
+        wide[i].key.message_type_index = kind % 3;
+        wide[i].counter = rand() % 100 + 1;
+        packed[i].key.code = (uint32_t) wide[i].key.error_code | ((uint32_t) wide[i].key.message_type_index << 30);
+        packed[i].key.principal = kind / 64;
+        packed[i].counter = wide[i].counter;
+    }
+
+    start = now();
+    for (r = 0; r < rounds; ++r) {
+        memset(wide_table, 0, sizeof(WideElem) * (mask + 1));
+        for (i = 0; i < intervals * entries; ++i) {
+            slot = wide_hash(&wide[i].key) & mask;
+            while (wide_table[slot].used &&
+                   memcmp(&wide_table[slot].key, &wide[i].key, sizeof(MessageInfo)) != 0)
+                slot = (slot + 1) & mask;
+            wide_table[slot].used = 1;
+            wide_table[slot].key = wide[i].key;
+            wide_table[slot].counter += wide[i].counter;
+        }
+        for (i = 0; i <= (int) mask; ++i)
+            wide_sum += wide_table[i].counter;
+    }
+    wide_time = now() - start;
+
+    start = now();
+    for (r = 0; r < rounds; ++r) {
+        memset(packed_table, 0, sizeof(PackedElem) * (mask + 1));
+        for (i = 0; i < intervals * entries; ++i) {
+            slot = packed_hash(&packed[i].key) & mask;
+            while (packed_table[slot].used &&
+                   (packed_table[slot].key.code != packed[i].key.code ||
+                    packed_table[slot].key.principal != packed[i].key.principal))
+                slot = (slot + 1) & mask;
+            packed_table[slot].used = 1;
+            packed_table[slot].key = packed[i].key;
+            packed_table[slot].counter += packed[i].counter;
+        }
+        for (i = 0; i <= (int) mask; ++i)
+            packed_sum += packed_table[i].counter;
+    }
+    packed_time = now() - start;
+
+    if (wide_sum != packed_sum) {
+        fprintf(stderr, "sums differ: %llu and %llu\n",
+                (unsigned long long) wide_sum, (unsigned long long) packed_sum);
+        return 1;
+    }
+    printf("%d intervals of %d entries, %d rounds\n", intervals, entries, rounds);
+    printf("MessageInfo entries (%zu bytes): %.3f ms per scan\n", sizeof(WideEntry), wide_time * 1000 / rounds);
+    printf("MessageKey entries (%zu bytes):  %.3f ms per scan\n", sizeof(PackedEntry), packed_time * 1000 / rounds);
+    printf("speed-up: %.2fx\n", wide_time / packed_time);
+    return 0;
+}
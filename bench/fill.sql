@@ -0,0 +1,2 @@
+-- Each client makes 32 message kinds of its own (as many as a backend keeps in an interval)
+SELECT logerrors_bench_raise(:client_id * 32, 32);
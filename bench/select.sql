@@ -0,0 +1,2 @@
+-- Transaction without messages, weighted against warning.sql for the rate of errors
+SELECT 1;
@@ -0,0 +1 @@
+SELECT count(*) FROM pg_log_errors_stats();
@@ -0,0 +1,238 @@
+#
+# Benchmarks of logerrors on a temporary instance, run by "make bench":
+#
+#   hook_overhead  pgbench throughput of clients which raise messages at a
+#                  given rate, without the extension and with it
+#   stats_read     latency of pg_log_errors_stats() with an empty ring, a full
+#                  ring and many distinct users and databases
+#
+# Each result is a JSON line appended to bench_results.jsonl (or to
+# $LOGERRORS_BENCH_RESULTS), so results of runs may be compared. A run is
+# tuned by environment variables:
+#
+#   LOGERRORS_BENCH_CLIENTS         pgbench clients (8)
+#   LOGERRORS_BENCH_TIME            seconds of each throughput run (10)
+#   LOGERRORS_BENCH_RATE            target transactions per second, unlimited
+#                                   if not set
+#   LOGERRORS_BENCH_ERROR_PERCENTS  percents of transactions which raise a
+#                                   message (0,10,100)
+#   LOGERRORS_BENCH_READS           calls of pg_log_errors_stats() (200)
+#   LOGERRORS_BENCH_USERS           users (64) and
+#   LOGERRORS_BENCH_DATABASES       databases (8) of the last read run
+#
+# pgbench ends a client on an error, so clients raise warnings, which go
+# through the log hook the same way.
+
+use strict;
+use warnings;
+use File::Basename;
+use IPC::Run;
+use Test::More;
+
+BEGIN
+{
+	plan skip_all => 'PostgreSQL::Test::Cluster of PostgreSQL 15 or later is needed'
+	  unless eval { require PostgreSQL::Test::Cluster; 1 };
+}
+
+my $scripts = dirname(__FILE__) . '/..';
+my $clients = $ENV{LOGERRORS_BENCH_CLIENTS} // 8;
+my $duration = $ENV{LOGERRORS_BENCH_TIME} // 10;
+my $rate = $ENV{LOGERRORS_BENCH_RATE};
+my @error_percents = split /,/,
+  ($ENV{LOGERRORS_BENCH_ERROR_PERCENTS} // '0,10,100');
+my $reads = $ENV{LOGERRORS_BENCH_READS} // 200;
+my $users = $ENV{LOGERRORS_BENCH_USERS} // 64;
+my $databases = $ENV{LOGERRORS_BENCH_DATABASES} // 8;
+my $results_file = $ENV{LOGERRORS_BENCH_RESULTS} // 'bench_results.jsonl';
+my $run = time();
+
+open(my $results, '>>', $results_file)
+  or die "could not open $results_file: $!\n";
+
+# Kinds of messages are made of codes Y0000, Y0001 and so on
+my $setup = <<'EOF';
+CREATE FUNCTION logerrors_bench_raise(base integer, count integer)
+    RETURNS void LANGUAGE plpgsql AS $$
+BEGIN
+    FOR i IN base .. base + count - 1 LOOP
+        RAISE WARNING USING ERRCODE = 'Y' || lpad(i::text, 4, '0'),
+            MESSAGE = 'logerrors bench';
+    END LOOP;
+END
+$$;
+EOF
+
+my $node = PostgreSQL::Test::Cluster->new('logerrors_bench');
+$node->init;
+$node->append_conf('postgresql.conf',
+	'max_connections = ' . ($clients + $databases + 20));
+$node->start;
+# Databases of the read runs are copied from template1
+$node->safe_psql($_, $setup) foreach ('postgres', 'template1');
+my $server_version = $node->safe_psql('postgres', 'SHOW server_version_num');
+
+sub result
+{
+	my (%fields) = @_;
+	my $line;
+
+	$fields{run} = $run;
+	$fields{server_version} = $server_version;
+	$line = '{'
+	  . join(', ',
+		map {
+			my $value = $fields{$_} // 'null';
+			"\"$_\": "
+			  . ($value =~ /^(-?\d+(\.\d+)?|null)$/ ? $value : "\"$value\"")
+		} sort keys %fields)
+	  . '}';
+	print $results "$line\n";
+	note $line;
+	return;
+}
+
+# Runs pgbench with the arguments, returns what it has measured
+sub pgbench
+{
+	my (@args) = @_;
+	my ($stdout, $stderr);
+	my $ok;
+
+	# Messages are logged, but not sent to the clients
+	local $ENV{PGOPTIONS} = '-c client_min_messages=error';
+	$ok = IPC::Run::run(
+		[ 'pgbench', '-n', '-h', $node->host, '-p', $node->port, @args, 'postgres' ],
+		'>', \$stdout, '2>', \$stderr);
+	ok($ok, "pgbench @args") or diag($stderr);
+	return (
+		tps => ($stdout =~ /^tps = ([\d.]+)/m)[0],
+		latency_ms => ($stdout =~ /^latency average = ([\d.]+) ms/m)[0],
+		transactions =>
+		  ($stdout =~ /^number of transactions actually processed: (\d+)/m)[0]);
+}
+
+# Calls of the hook and their time since start, nothing without the extension
+sub hook_stats
+{
+	my ($extension) = @_;
+
+	return () if $extension ne 'logerrors';
+	return split /\|/,
+	  $node->safe_psql('postgres',
+		'SELECT hook_calls, hook_time_ms FROM pg_log_errors_internal_stats()');
+}
+
+sub hook_overhead
+{
+	my ($extension) = @_;
+
+	foreach my $percent (@error_percents)
+	{
+		my @before = hook_stats($extension);
+		my %measured = pgbench(
+			'-c', $clients, '-j', $clients, '-T', $duration,
+			(defined $rate ? ('-R', $rate) : ()),
+			'-f', "$scripts/warning.sql\@$percent",
+			'-f', "$scripts/select.sql\@" . (100 - $percent));
+		my @after = hook_stats($extension);
+
+		result(
+			benchmark => 'hook_overhead',
+			extension => $extension,
+			clients => $clients,
+			rate => $rate,
+			error_percent => $percent,
+			hook_calls => (@after ? $after[0] - $before[0] : undef),
+			hook_time_ms => (@after ? $after[1] - $before[1] : undef),
+			%measured);
+	}
+	return;
+}
+
+sub stats_read
+{
+	my ($scenario) = @_;
+	my $rows = $node->safe_psql('postgres',
+		'SELECT count(*) FROM pg_log_errors_stats()');
+	my %measured = pgbench('-c', 1, '-t', $reads, '-f', "$scripts/stats.sql");
+	my ($scan_ms, $scan_entries) = split /\|/,
+	  $node->safe_psql('postgres',
+		'SELECT stats_scan_ms, stats_scan_entries FROM pg_log_errors_internal_stats()');
+
+	result(
+		benchmark => 'stats_read',
+		scenario => $scenario,
+		rows => $rows,
+		stats_scan_ms => $scan_ms,
+		stats_scan_entries => $scan_entries,
+		%measured);
+	return;
+}
+
+sub advance
+{
+	my ($count) = @_;
+	$node->safe_psql('postgres', "SELECT pg_log_errors_advance_interval($count)");
+	return;
+}
+
+hook_overhead('none');
+
+$node->append_conf('postgresql.conf', "shared_preload_libraries = 'logerrors'");
+$node->restart;
+$node->safe_psql('postgres', 'CREATE EXTENSION logerrors');
+hook_overhead('logerrors');
+
+# Rings are filled interval by interval on the manual clock
+$node->append_conf('postgresql.conf', 'logerrors.manual_clock = on');
+$node->restart;
+my ($intervals_count, $interval_slots) = split /\|/,
+  $node->safe_psql('postgres',
+	"SELECT current_setting('logerrors.intervals_count'), current_setting('logerrors.interval_slots')");
+
+$node->safe_psql('postgres', 'SELECT pg_log_errors_reset()');
+advance(1);
+stats_read('empty_ring');
+
+# A backend keeps 32 kinds in an interval, so slots are filled by many clients
+foreach (1 .. $intervals_count)
+{
+	my $fill_clients = int(($interval_slots + 31) / 32);
+	pgbench('-c', $fill_clients, '-j', $fill_clients, '-t', 1,
+		'-f', "$scripts/fill.sql");
+	advance(1);
+}
+stats_read('full_ring');
+
+$node->safe_psql('postgres', 'SELECT pg_log_errors_reset()');
+advance(1);
+$node->safe_psql('postgres',
+	join('', map { "CREATE ROLE logerrors_bench_$_;" } 1 .. $users));
+foreach my $database (1 .. $databases)
+{
+	$node->safe_psql('postgres', "CREATE DATABASE logerrors_bench_$database");
+	for (my $first = 1; $first <= $users; $first += 32)
+	{
+		my $last = $first + 31 > $users ? $users : $first + 31;
+		$node->safe_psql("logerrors_bench_$database", <<EOF);
+SET client_min_messages = error;
+DO \$\$
+BEGIN
+    FOR i IN $first .. $last LOOP
+        EXECUTE format('SET ROLE logerrors_bench_%s', i);
+        PERFORM logerrors_bench_raise(0, 1);
+        EXECUTE 'RESET ROLE';
+    END LOOP;
+END
+\$\$;
+EOF
+		advance(1);
+	}
+}
+stats_read('many_principals');
+
+$node->stop;
+close($results);
+
+done_testing();
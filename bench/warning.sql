@@ -0,0 +1,2 @@
+-- pgbench ends a client on an error, so a warning goes through the log hook instead
+SELECT logerrors_bench_raise(0, 1);
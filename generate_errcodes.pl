@@ -0,0 +1,87 @@
+#!/usr/bin/perl
+#
+# Generate logerrors_errcodes.h from errcodes.txt of the server and
+# errcodes_extra.txt: codes of errors made by MAKE_SQLSTATE() in ascending
+# order, so a name is found by binary search, names packed into one string
+# and classes of the codes.
+#
+#     perl generate_errcodes.pl errcodes.txt errcodes_extra.txt > logerrors_errcodes.h
+#
+# A code listed twice keeps its first name.
+
+use strict;
+use warnings;
+use File::Basename;
+
+die "usage: $0 errcodes.txt [errcodes_extra.txt ...]\n" unless @ARGV;
+
+my %names;
+
+foreach my $file (@ARGV)
+{
+	open(my $errcodes, '<', $file) or die "could not open $file: $!\n";
+	while (my $line = <$errcodes>)
+	{
+		chomp $line;
+		$line =~ s/\s+$//;
+		# Comments, empty lines and section headers
+		next if $line =~ /^#/ || $line eq '' || $line =~ /^Section:/;
+		die "unrecognized line in $file: $line\n"
+		  unless $line =~ /^([A-Z0-9]{5})\s+[EWS]\s+(ERRCODE_\S+)/;
+		my ($sqlstate, $name) = ($1, $2);
+		if (exists $names{$sqlstate})
+		{
+			warn "duplicate code $sqlstate of $name in $file\n"
+			  if $names{$sqlstate} ne $name;
+			next;
+		}
+		$names{$sqlstate} = $name;
+	}
+	close($errcodes);
+}
+
+# Same as MAKE_SQLSTATE() of elog.h
+sub make_sqlstate
+{
+	my ($sqlstate) = @_;
+	my $code = 0;
+	foreach my $i (0 .. 4)
+	{
+		$code |= ((ord(substr($sqlstate, $i, 1)) - ord('0')) & 0x3F) << (6 * $i);
+	}
+	return $code;
+}
+
+my %codes = map { $_ => make_sqlstate($_) } keys %names;
+my @sqlstates = sort { $codes{$a} <=> $codes{$b} } keys %names;
+my $offset = 0;
+my @offsets;
+foreach my $sqlstate (@sqlstates)
+{
+	push @offsets, $offset;
+	$offset += length($names{$sqlstate}) + 1;
+}
+die "names take $offset bytes, offsets are uint16\n" if $offset > 65535;
+
+# Classes are ERRCODE_TO_CATEGORY() of codes, the low 12 bits
+my %classes = map { ($codes{$_} & 0xFFF) => 1 } keys %codes;
+my @classes = sort { $a <=> $b } keys %classes;
+die "there are " . scalar(@classes) . " classes, their index is uint8\n" if @classes > 254;
+
+print "/* Generated by generate_errcodes.pl from "
+  . join(' and ', map { basename($_) } @ARGV)
+  . ", do not edit */\n\n";
+printf "#define error_codes_count\t%d\n\n", scalar @sqlstates;
+print "/* Error codes made by MAKE_SQLSTATE() in ascending order */\n";
+print "static const int error_codes[error_codes_count] = {\n";
+print join(",\n", map { sprintf("    %d", $codes{$_}) } @sqlstates), "\n};\n\n";
+print "/* Offset of name of each code in error_names */\n";
+print "static const uint16 error_name_offsets[error_codes_count] = {\n";
+print join(",\n", map { "    $_" } @offsets), "\n};\n\n";
+print "static const char error_names[] =\n";
+print join("\n", map { "    \"$names{$_}\\0\"" } @sqlstates), ";\n";
+
+printf "\n#define error_classes_count\t%d\n\n", scalar @classes;
+print "/* Classes of the codes, ERRCODE_TO_CATEGORY() in ascending order */\n";
+print "static const int error_classes[error_classes_count] = {\n";
+print join(",\n", map { "    $_" } @classes), "\n};\n";
@@ -0,0 +1,177 @@
+CREATE FUNCTION pg_log_errors_verify_window()
+    RETURNS boolean
+AS 'MODULE_PATHNAME', 'pg_log_errors_verify_window'
+    LANGUAGE C STRICT;
+
+-- Recounts the whole ring, only superusers may call it unless granted
+REVOKE ALL ON FUNCTION pg_log_errors_verify_window() FROM public;
+
+CREATE FUNCTION pg_slow_log_histogram(
+    OUT username text,
+    OUT database text,
+    OUT lower_bound_ms double precision,
+    OUT upper_bound_ms double precision,
+    OUT count bigint
+)
+    RETURNS SETOF record
+AS 'MODULE_PATHNAME', 'pg_slow_log_histogram'
+    LANGUAGE C STRICT;
+GRANT ALL ON FUNCTION pg_slow_log_histogram() TO public;
+
+CREATE FUNCTION pg_slow_log_percentiles(
+    OUT username text,
+    OUT database text,
+    OUT count bigint,
+    OUT p50_ms double precision,
+    OUT p95_ms double precision,
+    OUT p99_ms double precision
+)
+    RETURNS SETOF record
+AS 'MODULE_PATHNAME', 'pg_slow_log_percentiles'
+    LANGUAGE C STRICT;
+GRANT ALL ON FUNCTION pg_slow_log_percentiles() TO public;
+
+CREATE FUNCTION pg_log_errors_history(
+    since timestamp with time zone,
+    OUT bucket_start timestamp with time zone,
+    OUT bucket_end timestamp with time zone,
+    OUT type text,
+    OUT message text,
+    OUT sqlstate text,
+    OUT database text,
+    OUT username text,
+    OUT count bigint,
+    OUT estimated boolean
+)
+    RETURNS SETOF record
+AS 'MODULE_PATHNAME', 'pg_log_errors_history'
+    LANGUAGE C STRICT;
+
+CREATE FUNCTION pg_log_errors_stats_filtered(
+    filter_dbid oid DEFAULT NULL,
+    filter_userid oid DEFAULT NULL,
+    filter_type text DEFAULT NULL,
+    filter_sqlstate text DEFAULT NULL,
+    OUT time_interval integer,
+    OUT type text,
+    OUT message text,
+    OUT count integer,
+    OUT username text,
+    OUT database text,
+    OUT sqlstate text,
+    OUT dbid oid,
+    OUT userid oid,
+    OUT estimated boolean,
+    OUT application_name text,
+    OUT backend_type text,
+    OUT client_addr text
+)
+    RETURNS SETOF record
+AS 'MODULE_PATHNAME', 'pg_log_errors_stats_filtered'
+    LANGUAGE C;
+
+CREATE FUNCTION pg_log_errors_top(
+    k integer DEFAULT 10,
+    OUT fingerprint bigint,
+    OUT type text,
+    OUT message text,
+    OUT sqlstate text,
+    OUT count bigint,
+    OUT error bigint,
+    OUT sample text
+)
+    RETURNS SETOF record
+AS 'MODULE_PATHNAME', 'pg_log_errors_top'
+    LANGUAGE C STRICT;
+
+CREATE FUNCTION pg_log_errors_counters(
+    OUT type text,
+    OUT message text,
+    OUT sqlstate text,
+    OUT dbid oid,
+    OUT userid oid,
+    OUT database text,
+    OUT username text,
+    OUT count bigint
+)
+    RETURNS SETOF record
+AS 'MODULE_PATHNAME', 'pg_log_errors_counters'
+    LANGUAGE C STRICT;
+
+CREATE FUNCTION pg_log_errors_changes(
+    since bigint DEFAULT 0,
+    OUT sequence bigint,
+    OUT bucket_start timestamptz,
+    OUT bucket_end timestamptz,
+    OUT type text,
+    OUT message text,
+    OUT sqlstate text,
+    OUT database text,
+    OUT username text,
+    OUT count bigint,
+    OUT high_water bigint,
+    OUT estimated boolean,
+    OUT first_sequence bigint
+)
+    RETURNS SETOF record
+AS 'MODULE_PATHNAME', 'pg_log_errors_changes'
+    LANGUAGE C STRICT;
+
+CREATE FUNCTION pg_log_errors_internal_stats(
+    OUT hook_calls bigint,
+    OUT filtered bigint,
+    OUT sampled_out bigint,
+    OUT overflow bigint,
+    OUT evicted bigint,
+    OUT hook_timed_calls bigint,
+    OUT hook_time_ms double precision,
+    OUT hook_time_max_us double precision,
+    OUT ticks bigint,
+    OUT tick_lag_ms double precision,
+    OUT tick_lag_max_ms double precision,
+    OUT tick_time_ms double precision,
+    OUT stats_scan_ms double precision,
+    OUT stats_scan_entries bigint
+)
+    RETURNS SETOF record
+AS 'MODULE_PATHNAME', 'pg_log_errors_internal_stats'
+    LANGUAGE C STRICT;
+
+CREATE FUNCTION pg_log_errors_advance_interval(count integer DEFAULT 1)
+    RETURNS void
+AS 'MODULE_PATHNAME', 'pg_log_errors_advance_interval'
+    LANGUAGE C STRICT;
+REVOKE ALL ON FUNCTION pg_log_errors_advance_interval(integer) FROM public;
+
+CREATE FUNCTION pg_log_errors_backfill(since timestamptz, until timestamptz DEFAULT now())
+    RETURNS bigint
+AS 'MODULE_PATHNAME', 'pg_log_errors_backfill'
+    LANGUAGE C STRICT;
+-- Reads any file of log_directory, only superusers may call it unless granted
+REVOKE ALL ON FUNCTION pg_log_errors_backfill(timestamptz, timestamptz) FROM public;
+
+CREATE FUNCTION pg_log_errors_alerts(
+    OUT fired_at timestamptz,
+    OUT rule text,
+    OUT type text,
+    OUT message text,
+    OUT sqlstate text,
+    OUT count bigint,
+    OUT threshold double precision,
+    OUT baseline double precision,
+    OUT stddev double precision
+)
+    RETURNS SETOF record
+AS 'MODULE_PATHNAME', 'pg_log_errors_alerts'
+    LANGUAGE C STRICT;
+
+CREATE FUNCTION pg_log_errors_classes(
+    OUT time_interval integer,
+    OUT type text,
+    OUT class text,
+    OUT message text,
+    OUT count bigint
+)
+    RETURNS SETOF record
+AS 'MODULE_PATHNAME', 'pg_log_errors_classes'
+    LANGUAGE C STRICT;
@@ -1,20 +1,31 @@
 /* Some general headers for custom bgworker facility */
 #include "postgres.h"
+
+#include <math.h>
+#include <sys/stat.h>
+
 #include "fmgr.h"
 #include "access/xact.h"
 #include "lib/stringinfo.h"
 #include "pgstat.h"
 #include "executor/spi.h"
 #include "postmaster/bgworker.h"
+#include "postmaster/syslogger.h"
+#include "storage/fd.h"
 #include "storage/ipc.h"
 #include "storage/latch.h"
 #include "storage/proc.h"
+#include "storage/spin.h"
 #include "utils/guc.h"
 #include "utils/snapmgr.h"
+#include "utils/timestamp.h"
+#include "utils/datetime.h"
+#include "mb/pg_wchar.h"
 #include "miscadmin.h"
 #include "utils/memutils.h"
 #include "utils/hsearch.h"
 #include "utils/builtins.h"
+#include "utils/acl.h"
 #include "funcapi.h"
 #include "catalog/pg_authid.h"
 #include "utils/syscache.h"
@@ -25,11 +36,20 @@
 #include "access/htup_details.h"
 #include "commands/dbcommands.h"
 #include "utils/resowner.h"
+#include "port/pg_crc32c.h"
+#include "portability/instr_time.h"
 #if PG_VERSION_NUM < 100000
 #include "port/atomics.h"
+#else
+#include "utils/dsa.h"
+#endif
+#if PG_VERSION_NUM < 150000
+#include "postmaster/autovacuum.h"
+#include "replication/walsender.h"
 #endif
 
 #include "constants.h"
+#include "logerrors_errcodes.h"
 
 /* Allow load of this module in shared libs */
 PG_MODULE_MAGIC;
@@ -40,9 +60,11 @@ void _PG_fini(void);
 
 /* Shared memory init */
 static void logerrors_shmem_startup(void);
+static Size logerrors_memsize(void);
 
 /* Signal handling */
 static volatile sig_atomic_t got_sigterm = false;
+static volatile sig_atomic_t got_sighup = false;
 
 static void logerrors_load_params(void);
 /* GUC variables */
@@ -50,12 +72,34 @@ static void logerrors_load_params(void);
 static int interval = 5000;
 /* While that count of intervals messages doesn't dropping from statistic */
 static int intervals_count = 120;
+/* Count of distinct messages counted in one interval, the rest goes to overflow */
+static int interval_slots = 512;
+/* Save statistics to disk on shutdown and load them on start */
+static bool save_stats = true;
+/* Count of intervals between saving statistics, 0 saves only on shutdown */
+static int save_intervals = 0;
+/*
+ * Count of buckets in each tier of rollup_tier_periods, 0 disables the tier.
+ * Shared memory is allocated for this count, a bucket takes about 18 bytes
+ * per tier slot: 2.3KB with the default tier_slots.
+ */
+static int minute_buckets = 180;
+static int hour_buckets = 168;
+/* Count of distinct messages counted in one bucket of a tier */
+static int tier_slots = 128;
+/* Count of messages of one kind a backend counts one by one in an interval, 0 counts all */
+static int sample_threshold = 0;
+/* Intervals are closed only by pg_log_errors_advance_interval(), for tests and benchmarks */
+static bool manual_clock = false;
+/* Count of intervals baselines of alerts mostly remember */
+static int alert_baseline_intervals = 60;
 
 /* Misc init */
 static void slow_log_info_init(void);
 static void global_variables_init(void);
 static void logerrors_init(void);
 static void logerrors_update_info(void);
+static const char *get_error_name(int error_code);
 
 /* Worker name */
 static char *worker_name = "logerrors";
@@ -68,10 +112,9 @@ static void logerrors_shmem_request(void);
 #endif
 
 static char* excluded_errcodes_str= NULL;
-
-typedef struct error_code {
-    int num;
-} ErrorCode;
+static char* included_errcodes_str= NULL;
+static char* dimensions_str = NULL;
+static char* alert_rules_str = NULL;
 
 /* Depends on message_types_count, max_number_of_intervals */
 typedef struct message_info {
@@ -79,49 +122,625 @@ typedef struct message_info {
     Oid db_oid;
     Oid user_oid;
     int message_type_index;
+    /* Number in Sources, 0 if logerrors.dimensions is empty */
+    uint32 source;
 } MessageInfo;
 
-typedef struct error_name {
-    ErrorCode code;
-    char* name;
-} ErrorName;
+/*
+ * MessageInfo as intervals keep it: SQLSTATE takes the lower 30 bits of code
+ * and message type the upper 2 bits, database, user and source are replaced
+ * by their number in Principals. See message_key_pack().
+ */
+typedef struct message_key {
+    uint32 code;
+    uint32 principal;
+} MessageKey;
+
+#define message_key_error_code(key)	((int) ((key).code & 0x3FFFFFFF))
+#define message_key_type_index(key)	((int) ((key).code >> 30))
+
+typedef struct principal {
+    Oid db_oid;
+    Oid user_oid;
+    uint32 source;
+} Principal;
+
+/*
+ * Databases, users and sources of counted messages in order of appearance,
+ * index is the same as in IntervalCounters. Only the worker adds them and
+ * they stay until restart, readers see a principal once used_count covers
+ * it. The one after principals_count has no database, user and source and
+ * stands for the rest of them.
+ */
+typedef struct principals {
+    pg_atomic_uint32 used_count;
+    uint16 index[principals_count * 2];
+    Principal entries[principals_count + 1];
+} Principals;
+
+/* Dimensions of logerrors.dimensions */
+#define dimension_application_name	0x01
+#define dimension_backend_type	0x02
+#define dimension_client_addr	0x04
+
+/* Dimensions of a backend which are asked for, others are empty and -1 */
+typedef struct source {
+    char application_name[NAMEDATALEN];
+    char client_addr[source_client_addr_len];
+    int backend_type;
+} Source;
+
+/*
+ * Sources of counted messages in order of appearance. Backends add them
+ * under mutex and they stay until restart, readers see a source once
+ * used_count covers it. The first one has no dimensions, the one after
+ * sources_count has none either and stands for the rest of them.
+ */
+typedef struct sources {
+    slock_t mutex;
+    pg_atomic_uint32 used_count;
+    Source entries[sources_count + 1];
+} Sources;
 
 typedef struct slow_log_info {
     pg_atomic_uint32 count;
     pg_atomic_uint64 reset_time;
 } SlowLogInfo;
 
+/* Durations of "duration: ..." messages of one database and user since reset */
+typedef struct slow_log_histogram {
+    Oid db_oid;
+    Oid user_oid;
+    pg_atomic_uint32 buckets[slow_log_buckets_count];
+} SlowLogHistogram;
+
+/*
+ * Histograms are added under mutex and stay until reset, so they are looked
+ * up without lock. The one after slow_log_histograms_count slots has no
+ * database and user and counts the rest of them.
+ */
+typedef struct slow_log_histograms {
+    slock_t mutex;
+    pg_atomic_uint32 used_count;
+    /* Changes on reset, so backends drop their cached histogram */
+    pg_atomic_uint32 generation;
+    SlowLogHistogram histograms[slow_log_histograms_count + 1];
+} SlowLogHistograms;
+
+/* Statistics saved across restarts, see logerrors_save() */
+#define logerrors_dump_file	PGSTAT_STAT_PERMANENT_DIRECTORY "/logerrors.stat"
+#define logerrors_dump_magic	0x4C455231
+#define logerrors_dump_version	10
+
+/* Count of a message kind out of shared memory */
+typedef struct message_count {
+    MessageInfo key;
+    uint32 count;
+    /* See interval_counters_estimated() */
+    uint16 estimated;
+} MessageCount;
+
+#define duration_prefix	"duration: "
+#define duration_prefix_len	(sizeof(duration_prefix) - 1)
+
+typedef struct counter_entry {
+    MessageKey key;
+    pg_atomic_uint32 counter;
+} CounterEntry;
+
+/*
+ * Counters of one interval or of the whole window. Entries are appended one
+ * after another and index is an open-addressing table over them: 0 - empty
+ * slot, otherwise entry number + 1. Counters are changed only by the worker,
+ * readers see an entry once entries_count covers it.
+ * Index, entries and their estimated counts are sized at startup and follow
+ * the header, see interval_counters_size().
+ */
+typedef struct interval_counters {
+    /* Capacity and size of index (power of two) */
+    int slots;
+    int index_size;
+    /*
+     * Odd while the worker changes counters which readers may copy: the
+     * window, a closed interval being reused or a bucket being filled. See
+     * copy_interval().
+     */
+    pg_atomic_uint32 change_count;
+    /*
+     * TimestampTz of interval start and end, end is 0 while interval is
+     * open. Not used by the window.
+     */
+    pg_atomic_uint64 start_time;
+    pg_atomic_uint64 end_time;
+    /* Number of the interval among closed ones, 0 while it is open. Not used by the window. */
+    pg_atomic_uint64 sequence;
+    pg_atomic_uint32 entries_count;
+    /* Messages which didn't get a slot, per message type */
+    pg_atomic_uint32 overflow_count[message_types_count];
+} IntervalCounters;
+
+#define interval_counters_index(counters) \
+    ((uint16 *) ((char *) (counters) + MAXALIGN(sizeof(IntervalCounters))))
+#define interval_counters_entries(counters) \
+    ((CounterEntry *) ((char *) interval_counters_index(counters) + \
+                       MAXALIGN(sizeof(uint16) * (counters)->index_size)))
+/*
+ * How many times a sampled count was added to the entry, see
+ * logerrors.sample_threshold. It is subtracted with the count from the
+ * window and sticks at PG_UINT16_MAX.
+ */
+#define interval_counters_estimated(counters) \
+    ((uint16 *) ((char *) interval_counters_entries(counters) + \
+                 MAXALIGN(sizeof(CounterEntry) * (counters)->slots)))
+
+typedef struct backend_counter {
+    MessageInfo key;
+    uint32 counter;
+    /* Some of the messages were sampled and counted with their weight */
+    bool estimated;
+} BackendCounter;
+
+/* Messages with the same fingerprint, see message_fingerprint() */
+typedef struct fingerprint_counter {
+    uint64 fingerprint;
+    uint32 counter;
+    int error_code;
+    int message_type_index;
+    /* Text of the first of these messages */
+    char sample[fingerprint_sample_len];
+} FingerprintCounter;
+
+/* Classes of codes counted apart, classes which are not in errcodes.txt share the last one */
+#define error_class_slots	(error_classes_count + 1)
+
+/*
+ * Messages of one backend (PGPROC slot) counted since the last interval
+ * switch. Only the owning backend writes here, so the hook doesn't touch
+ * cache lines shared with other backends. The worker moves counters to the
+ * current interval under mutex, total_count stays and is summed by readers.
+ * Totals are counted since reset totals_epoch: the owner zeroes them when it
+ * counts its first message after reset, readers skip totals of older epochs.
+ * Counts of classes are drained by the worker like counters.
+ */
+typedef struct backend_counters {
+    slock_t mutex;
+    /* Reset epoch the counters below were counted in, see pg_log_errors_reset() */
+    uint64 epoch;
+    int used_count;
+    /* Messages which didn't get a slot, per message type */
+    uint32 overflow_count[message_types_count];
+    /* Messages per class of code, see error_class_index */
+    uint32 class_count[message_types_count][error_class_slots];
+    /* Same layout as in IntervalCounters, keeps order in which messages came */
+    uint8 index[backend_slots * 2];
+    BackendCounter counters[backend_slots];
+    int fingerprints_used;
+    /* Messages whose fingerprint didn't get a slot, per message type */
+    uint32 fingerprints_dropped[message_types_count];
+    FingerprintCounter fingerprints[backend_fingerprint_slots];
+    pg_atomic_uint64 totals_epoch;
+    pg_atomic_uint64 total_count[message_types_count];
+    /* Cost of the hook since start, see pg_log_errors_internal_stats() */
+    pg_atomic_uint64 hook_calls;
+    /* Messages not counted by logerrors.excluded_errcodes and included_errcodes */
+    pg_atomic_uint64 filtered_count;
+    /* Messages skipped by sampling, see message_sample_weight() */
+    pg_atomic_uint64 sampled_out_count;
+    /* Every hook_timing_sample call is timed */
+    pg_atomic_uint64 timed_calls;
+    pg_atomic_uint64 hook_time_ns;
+    pg_atomic_uint64 hook_time_max_ns;
+} BackendCounters;
+
+/*
+ * Space-Saving summary of message fingerprints: when a new fingerprint
+ * comes and there is no free entry, it replaces the entry with the least
+ * count and inherits that count as its error. So count overestimates the
+ * real count by at most error, and any fingerprint seen more often than
+ * the least count is in the summary. Only the worker writes it.
+ */
+typedef struct heavy_hitter {
+    uint64 fingerprint;
+    uint64 count;
+    uint64 error;
+    int error_code;
+    int message_type_index;
+    char sample[fingerprint_sample_len];
+} HeavyHitter;
+
+typedef struct heavy_hitters {
+    slock_t mutex;
+    int used_count;
+    /* Messages dropped by backends without a fingerprint slot, per message type */
+    uint64 dropped_count[message_types_count];
+    HeavyHitter entries[heavy_hitters_count];
+} HeavyHitters;
+
+/*
+ * Counters of messages since reset, they only grow until reset. Added by
+ * the worker when an interval closes. When there is no free entry for a new
+ * message kind, a clock hand looks for the victim: it clears the referenced
+ * flag of entries which changed since it passed them last time and evicts
+ * the first entry without it, so an eviction costs a few steps instead of a
+ * scan of all entries. Count of the victim goes to evicted_count of its
+ * message type. Index is the same as in IntervalCounters. Only the worker
+ * writes, under mutex.
+ */
+typedef struct cumulative_counter {
+    MessageInfo key;
+    uint64 count;
+    /* Changed since the clock hand passed the entry */
+    bool referenced;
+} CumulativeCounter;
+
+typedef struct cumulative_counters {
+    slock_t mutex;
+    int used_count;
+    /* Entry the clock hand looks at next */
+    int clock_hand;
+    uint64 tick;
+    /* Per message type */
+    uint64 evicted_count[message_types_count];
+    uint64 overflow_count[message_types_count];
+    uint16 index[cumulative_slots * 2];
+    CumulativeCounter entries[cumulative_slots];
+} CumulativeCounters;
+
+/* Every backend counters start on its own cache line */
+#define backend_counters_size	TYPEALIGN(PG_CACHE_LINE_SIZE, sizeof(BackendCounters))
+
 typedef struct messages_buffer {
     pg_atomic_uint64 current_interval_index;
-    pg_atomic_uint64 current_message_index;
-    /* depends on messages per interval and max intervals count */
-    MessageInfo buffer[messages_per_interval * max_actual_intervals_count];
+    /* Sequence of the last closed interval, doesn't go back on reset */
+    pg_atomic_uint64 last_sequence;
+    /* Size of one IntervalCounters with its index and entries */
+    Size interval_size;
 } MessagesBuffer;
 
+/*
+ * Ring of buckets of one rollup tier. Each closed interval is added to the
+ * current bucket, a new bucket starts when an interval starts in the next
+ * period. Buckets are IntervalCounters, their start and end are start of
+ * the first interval and end of the last one added, so a bucket is read
+ * while it is still being filled. Only the worker writes.
+ */
+typedef struct rollup_tier {
+    int buckets_count;
+    /* Offset of the first bucket from the start of the tiers buffer */
+    Size offset;
+    /* Size of one bucket with its index and entries */
+    Size bucket_size;
+    /* Number of the current bucket, the ring index is taken modulo buckets_count */
+    pg_atomic_uint64 current_bucket;
+} RollupTier;
+
+/*
+ * Messages of one kind read from log files which fall into one bucket.
+ * Buckets of hourly keys are older than the minute tier reaches back, only
+ * the hour tier takes them. Overflow keys count messages of their type which
+ * didn't fit into backfill_max_keys.
+ */
+typedef struct backfill_key {
+    TimestampTz bucket_start;
+    MessageInfo info;
+    bool hourly;
+    bool overflow;
+} BackfillKey;
+
+typedef struct backfill_entry {
+    BackfillKey key;
+    uint32 count;
+} BackfillEntry;
+
+/*
+ * Counters which pg_log_errors_backfill() passes to the worker, newest
+ * bucket first, as the worker is the only writer of tiers. A backend owns
+ * the queue for the whole backfill, a new one starts when the previous is
+ * applied and gets the next backfill_id. All fields are under mutex.
+ */
+typedef struct backfill_queue {
+    slock_t mutex;
+    int owner_pid;
+    uint64 backfill_id;
+    /* Counters passed and applied by the worker in the current backfill */
+    uint64 queued_count;
+    uint64 applied_count;
+    int used_count;
+    BackfillEntry entries[backfill_queue_size];
+} BackfillQueue;
+
+/*
+ * Where the worker puts the next older bucket of a backfill in a tier.
+ * Backfill fills free buckets before the oldest started one, buckets of
+ * its start and later already have live statistics.
+ */
+typedef struct backfill_cursor {
+    /* Bucket which is filled and its start, limit while there is none */
+    IntervalCounters *bucket;
+    TimestampTz bucket_start;
+    int next_bucket;
+    bool full;
+} BackfillCursor;
+
+/*
+ * Rule of logerrors.alert_rules: count of messages with a code in an
+ * interval above threshold, or above baseline of the code by threshold
+ * standard deviations if sigma. Any code matches any_code, a class matches
+ * whole_class like in ErrcodesList.
+ */
+typedef struct alert_rule {
+    int error_code;
+    bool whole_class;
+    bool any_code;
+    bool sigma;
+    double threshold;
+    char text[alert_rule_len];
+} AlertRule;
+
+/*
+ * Exponentially weighted mean and variance of counts per interval of
+ * messages with a code and type. Only the worker keeps them, in its memory.
+ */
+typedef struct alert_baseline {
+    int error_code;
+    int message_type_index;
+    double mean;
+    double variance;
+    uint64 intervals;
+    /* A rule has fired and the count didn't fall below thresholds since */
+    bool firing;
+} AlertBaseline;
+
+typedef struct alert_event {
+    /* End of the interval whose count fired the rule */
+    TimestampTz fired_at;
+    int error_code;
+    int message_type_index;
+    uint64 count;
+    double threshold;
+    double mean;
+    double stddev;
+    char rule[alert_rule_len];
+} AlertEvent;
+
+/* Ring of the last fired alerts, only the worker writes, under mutex */
+typedef struct alert_events {
+    slock_t mutex;
+    uint64 fired_count;
+    AlertEvent events[alert_events_count];
+} AlertEvents;
+
+/*
+ * Counts of messages per class of code and type in the last closed interval,
+ * in the long window and since reset, so reading them costs the same
+ * whatever was counted. The worker drains class_count of backends on every
+ * tick and writes them under mutex.
+ */
+typedef struct class_counters {
+    slock_t mutex;
+    uint64 interval_count[message_types_count][error_class_slots];
+    uint64 window_count[message_types_count][error_class_slots];
+    uint64 total_count[message_types_count][error_class_slots];
+} ClassCounters;
+
+/*
+ * Cost of the worker and of readers since start, see
+ * pg_log_errors_internal_stats(). Ticks are written only by the worker, the
+ * scan by the last pg_log_errors_stats() call.
+ */
+typedef struct internal_stats {
+    pg_atomic_uint64 ticks_count;
+    /* How late the last tick started and the max of that */
+    pg_atomic_uint64 tick_lag_us;
+    pg_atomic_uint64 tick_lag_max_us;
+    /* Time of the last tick */
+    pg_atomic_uint64 tick_time_us;
+    pg_atomic_uint64 scan_time_us;
+    pg_atomic_uint64 scan_entries;
+} InternalStats;
+
+/* Verdict bits of a SQLSTATE class in ErrcodesFilter */
+#define filter_class_counted	0x01
+#define filter_class_has_exceptions	0x02
+
+/*
+ * Which messages are counted. Codes whose verdict differs from verdict of
+ * their class are kept in open-addressing table codes, -1 is an empty slot.
+ */
+typedef struct errcodes_filter {
+    uint8 classes[errcode_classes_count];
+    int codes[filter_index_size];
+} ErrcodesFilter;
+
+/* Parsed list of errcodes, whole_class entries hold the class only */
+typedef struct errcodes_list {
+    int count;
+    int codes[max_filter_codes];
+    bool whole_class[max_filter_codes];
+} ErrcodesList;
+
 /* Depends on message_types_count */
 typedef struct global_info {
     int interval;
     int intervals_count;
     /* Actual count of intervals in MessagesBuffer */
     int actual_intervals_count;
-    /* index of current interval in buffer */
-    pg_atomic_uint32 total_count[3];
+    /* Count of intervals which fit into the fixed shared memory */
+    int ring_place_count;
+    /*
+     * Interval, intervals_count, actual_intervals_count and location of the
+     * ring change together on reload, see intervals_ring_attach().
+     */
+    slock_t ring_mutex;
+#if PG_VERSION_NUM >= 100000
+    /* Dynamic shared memory area, created by the worker on the first resize */
+    bool ring_area_created;
+    int ring_tranche_id;
+    dsa_handle ring_area_handle;
+    /* Ring in the area, invalid while the ring is in the fixed shared memory */
+    dsa_pointer ring_pointer;
+    /* Ring replaced on reload, freed by the worker once it has no readers */
+    dsa_pointer old_ring_pointer;
+    /*
+     * Readers pin the ring they attach to until the end of their transaction,
+     * ring_generation tells which ring it is. Rings aren't replaced again
+     * while the old one has readers.
+     */
+    uint64 ring_generation;
+    int ring_readers;
+    int old_ring_readers;
+#endif
+    /* Capacity of one interval and of the long window */
+    int interval_slots;
+    int window_slots;
+    /*
+     * Count of BackendCounters for PGPROC slots, one more after them is
+     * shared by processes without a slot of their own.
+     */
+    int backends_count;
     SlowLogInfo slow_log_info;
     MessagesBuffer messagesBuffer;
-    int excluded_errcodes[error_codes_count];
-    int excluded_errcodes_count;
+    /*
+     * The worker builds the filter into the inactive one of filters and
+     * increments filter_generation, whose lowest bit is the active one. Two
+     * quick rebuilds may overwrite the filter a backend still probes, so the
+     * hook probes again if the generation has changed meanwhile.
+     */
+    pg_atomic_uint32 filter_generation;
+    ErrcodesFilter filters[2];
+    /*
+     * pg_log_errors_reset() only increments reset_epoch, the worker resets
+     * statistics on its next tick and sets applied_reset_epoch. Meanwhile
+     * readers see statistics as empty.
+     */
+    pg_atomic_uint64 reset_epoch;
+    pg_atomic_uint64 applied_reset_epoch;
+    /* dimension_* flags of logerrors.dimensions, set by the worker on reload */
+    pg_atomic_uint32 dimensions;
+    /*
+     * Time of logerrors is ahead of the server time by clock_offset (us),
+     * which only the worker moves with logerrors.manual_clock. Ticks are
+     * requested by pg_log_errors_advance_interval() and done by the worker.
+     */
+    pg_atomic_uint64 clock_offset;
+    pg_atomic_uint64 requested_ticks;
+    pg_atomic_uint64 done_ticks;
+    /* Set by the worker, so backends wake it up */
+    Latch *worker_latch;
+    InternalStats internal_stats;
 } GlobalInfo;
 
 typedef struct counter_hashelem {
-    MessageInfo key;
+    MessageKey key;
     int counter;
 } CounterHashElem;
 
 static GlobalInfo *global_variables = NULL;
 
-static HTAB *error_names_hashtable = NULL;
+/*
+ * Fixed shared memory for the ring of intervals and count of intervals in
+ * it. The count is taken from intervals_count when the memory is requested
+ * and kept, as intervals_count may change on reload.
+ */
+static char *ring_place = NULL;
+static int ring_place_count = 0;
+#if PG_VERSION_NUM >= 100000
+static dsa_area *ring_area = NULL;
+/* Generation of the ring this backend has pinned, see intervals_ring_attach() */
+static bool ring_pinned = false;
+static uint64 pinned_ring_generation = 0;
+/* The worker replaces the ring once readers of the old one are done */
+static bool ring_resize_postponed = false;
+#endif
+
+/*
+ * IntervalCounters of all intervals and their count as this process sees
+ * them, set by intervals_ring_attach().
+ */
+static char *intervals_buffer = NULL;
+static int ring_intervals_count = 0;
+
+/* Sum of intervals_count last closed intervals, maintained by the worker */
+static IntervalCounters *window_counters = NULL;
+
+/* BackendCounters of all backends, depends on backends count */
+static char *backends_buffer = NULL;
+
+static SlowLogHistograms *slow_log_histograms = NULL;
+
+static HeavyHitters *heavy_hitters = NULL;
+
+static CumulativeCounters *cumulative_counters = NULL;
+
+static Principals *principals = NULL;
+
+static Sources *sources = NULL;
+
+/* RollupTier of every tier followed by their buckets */
+static char *tiers_buffer = NULL;
+
+static BackfillQueue *backfill_queue = NULL;
+
+static AlertEvents *alert_events = NULL;
+
+static ClassCounters *class_counters = NULL;
+
+/* Backfill which the worker applies and its place in every tier */
+static uint64 backfill_applied_id = 0;
+static BackfillCursor backfill_cursors[rollup_tiers_count];
+static BackfillEntry backfill_batch[backfill_queue_size];
+
+/* Rules and baselines of alerts, only in the worker */
+static AlertRule alert_rules[max_alert_rules];
+static int alert_rules_count = 0;
+static AlertBaseline alert_baselines[alert_baselines_count];
+static int alert_baselines_used = 0;
+/* Count of messages of each baseline in the closed interval */
+static uint64 alert_counts[alert_baselines_count];
+
+/*
+ * Counts of classes drained since the last tick and counts of the last
+ * closed intervals, class_ticks of them, only in the worker
+ */
+static uint64 class_tick_count[message_types_count][error_class_slots];
+static uint32 class_ring[max_intervals_count][message_types_count][error_class_slots];
+static uint64 class_ticks = 0;
+
+/* Slot of every class in class counters, see error_classes_build() */
+static uint8 error_class_index[errcode_classes_count];
+
+/* Histogram of last database and user which had slow queries in this backend */
+static int cached_histogram = -1;
+static Oid cached_histogram_db_oid = InvalidOid;
+static Oid cached_histogram_user_oid = InvalidOid;
+static uint32 cached_histogram_generation = 0;
+
+/* Source of this backend, looked up again if dimensions or application name change */
+static int cached_source = -1;
+static uint32 cached_source_dimensions = 0;
+static char cached_source_application_name[NAMEDATALEN];
+
+
+/*
+ * Messages of this backend seen in the current interval, to choose their
+ * sampling rate, see message_sample_weight(). Keys which collide just start
+ * counting again.
+ */
+typedef struct sampled_message {
+    MessageInfo key;
+    /* last_sequence of MessagesBuffer when the key was seen first */
+    uint64 sequence;
+    uint32 seen_count;
+} SampledMessage;
+
+static SampledMessage sampled_messages[backend_slots * 2];
+
+/* Calls of the hook in this backend, to time every hook_timing_sample one */
+static uint32 hook_calls_count = 0;
 
 void logerrors_emit_log_hook(ErrorData *edata);
+static uint64 message_fingerprint(ErrorData *edata, int message_type_index);
+static void interval_counters_init(IntervalCounters *counters, int slots);
 
 static void
 logerrors_sigterm(SIGNAL_ARGS)
@@ -133,641 +752,5423 @@ logerrors_sigterm(SIGNAL_ARGS)
     errno = save_errno;
 }
 
+static void
+logerrors_sighup(SIGNAL_ARGS)
+{
+    int save_errno = errno;
+    got_sighup = true;
+    if (MyProc)
+        SetLatch(&MyProc->procLatch);
+    errno = save_errno;
+}
+
+/* Time of logerrors, the server time unless logerrors.manual_clock moved it ahead */
+static TimestampTz
+logerrors_now(void)
+{
+    return GetCurrentTimestamp() + (TimestampTz) pg_atomic_read_u64(&global_variables->clock_offset);
+}
+
+/* Account a tick which started lag_us late and took time_us, only the worker calls it */
+static void
+internal_stats_tick(int64 lag_us, int64 time_us)
+{
+    InternalStats *stats = &global_variables->internal_stats;
+    pg_atomic_write_u64(&stats->ticks_count, pg_atomic_read_u64(&stats->ticks_count) + 1);
+    pg_atomic_write_u64(&stats->tick_lag_us, (uint64) lag_us);
+    if ((uint64) lag_us > pg_atomic_read_u64(&stats->tick_lag_max_us))
+        pg_atomic_write_u64(&stats->tick_lag_max_us, (uint64) lag_us);
+    pg_atomic_write_u64(&stats->tick_time_us, (uint64) Max(time_us, 0));
+}
+
 #if PG_VERSION_NUM >= 180000
 pg_noreturn PGDLLEXPORT void logerrors_main(Datum);
 #else
 PGDLLEXPORT void logerrors_main(Datum) pg_attribute_noreturn();
 #endif
 
-static void
-global_variables_init(void)
+/* Power of two index size keeping open-addressing load factor at most 1/2 */
+static int
+interval_index_size(int slots)
 {
-    int sqlstate;
-    int errcodes_count;
-    char* excluded_errcode_str;
-    char excluded_errcodes_copy[error_codes_count * (len_sqlstate_str + 1)];
-    global_variables->intervals_count = intervals_count;
-    global_variables->actual_intervals_count = intervals_count + 5;
-    global_variables->interval = interval;
-
-    memset(&global_variables->excluded_errcodes, '\0', sizeof(global_variables->excluded_errcodes));
+    int size = 2;
+    while (size < 2 * slots)
+        size *= 2;
+    return size;
+}
 
-    errcodes_count = sizeof(excluded_errcodes) / sizeof(excluded_errcodes[0]);
-    global_variables->excluded_errcodes_count = errcodes_count;
+static Size
+interval_counters_size(int slots)
+{
+    return MAXALIGN(sizeof(IntervalCounters)) +
+           MAXALIGN(sizeof(uint16) * interval_index_size(slots)) +
+           MAXALIGN(sizeof(CounterEntry) * slots) +
+           MAXALIGN(sizeof(uint16) * slots);
+}
 
-    memcpy(&global_variables->excluded_errcodes[0], excluded_errcodes, sizeof(excluded_errcodes));
-    if (excluded_errcodes_str == NULL)
-        return;
-    memset(&excluded_errcodes_copy, '\0', sizeof(excluded_errcodes_copy));
-    strlcpy(&excluded_errcodes_copy[0], excluded_errcodes_str, error_codes_count * (len_sqlstate_str + 1) - 1);
+/* Count of PGPROC slots which can emit messages */
+static int
+get_backends_count(void)
+{
+#if PG_VERSION_NUM >= 150000
+    return MaxBackends + NUM_AUXILIARY_PROCS;
+#else
+    /* MaxBackends isn't calculated yet when shared memory is requested */
+    return MaxConnections + autovacuum_max_workers + 1 + max_worker_processes +
+#if PG_VERSION_NUM >= 120000
+           max_wal_senders +
+#endif
+           NUM_AUXILIARY_PROCS;
+#endif
+}
 
-    excluded_errcode_str = strtok(excluded_errcodes_copy, ",");
-    while (excluded_errcode_str != NULL) {
-        if (strlen(excluded_errcode_str) != len_sqlstate_str) {
-            elog(WARNING, "logerrors: errcode length should be equal to %d", len_sqlstate_str);
-            excluded_errcode_str = strtok(NULL, ",");
-            continue;
-        }
-        sqlstate = MAKE_SQLSTATE(excluded_errcode_str[0],
-                                 excluded_errcode_str[1],
-                                 excluded_errcode_str[2],
-                                 excluded_errcode_str[3],
-                                 excluded_errcode_str[4]);
+static BackendCounters *
+get_backend_counters(int backend_index)
+{
+    return (BackendCounters *) (backends_buffer + backend_index * backend_counters_size);
+}
 
-        global_variables->excluded_errcodes[global_variables->excluded_errcodes_count] = sqlstate;
-        global_variables->excluded_errcodes_count += 1;
-        if (global_variables->excluded_errcodes_count == error_codes_count - 1)
-            break;
+/* Same kinds of messages usually repeat across intervals */
+static int
+get_window_slots(void)
+{
+    return Min(interval_slots * 4, max_interval_slots * 2);
+}
 
-        excluded_errcode_str = strtok(NULL, ",");
-    }
+static IntervalCounters *
+get_interval_counters(int interval_index)
+{
+    return (IntervalCounters *) (intervals_buffer +
+                                 interval_index * global_variables->messagesBuffer.interval_size);
 }
 
+#if PG_VERSION_NUM >= 100000
+/* Called with ring_mutex held */
 static void
-slow_log_info_init(void)
+intervals_ring_unpin_locked(void)
 {
-    pg_atomic_init_u32(&global_variables->slow_log_info.count, 0);
-    pg_atomic_init_u64(&global_variables->slow_log_info.reset_time, GetCurrentTimestamp());
+    if (pinned_ring_generation == global_variables->ring_generation)
+        global_variables->ring_readers--;
+    else
+        global_variables->old_ring_readers--;
+    ring_pinned = false;
 }
+#endif
 
+/* Readers are done with the ring at the end of the transaction, also on error */
 static void
-add_message(int err_code, Oid db_oid, Oid user_oid, int message_type_index) {
-    int index_to_write;
-    int current_message;
-    int current_interval;
-    if (global_variables == NULL)
+logerrors_xact_callback(XactEvent event, void *arg)
+{
+#if PG_VERSION_NUM >= 100000
+    if (!ring_pinned || global_variables == NULL)
         return;
-    current_interval = pg_atomic_read_u64(&global_variables->messagesBuffer.current_interval_index) % (uint64)global_variables->actual_intervals_count;
-    current_message = pg_atomic_fetch_add_u64(&global_variables->messagesBuffer.current_message_index, 1) % (uint64)messages_per_interval;
-    index_to_write = current_interval * messages_per_interval + current_message;
-    global_variables->messagesBuffer.buffer[index_to_write].db_oid = db_oid;
-    global_variables->messagesBuffer.buffer[index_to_write].user_oid = user_oid;
-    global_variables->messagesBuffer.buffer[index_to_write].message_type_index = message_type_index;
-    global_variables->messagesBuffer.buffer[index_to_write].error_code = err_code;
+    switch (event) {
+        case XACT_EVENT_COMMIT:
+        case XACT_EVENT_PARALLEL_COMMIT:
+        case XACT_EVENT_ABORT:
+        case XACT_EVENT_PARALLEL_ABORT:
+        case XACT_EVENT_PREPARE:
+            SpinLockAcquire(&global_variables->ring_mutex);
+            intervals_ring_unpin_locked();
+            SpinLockRelease(&global_variables->ring_mutex);
+            break;
+        default:
+            break;
+    }
+#endif
 }
 
-static char*
-get_user_by_oid(Oid user_oid)
+/*
+ * See the ring of intervals the worker published last. The ring starts in
+ * the fixed shared memory and moves to dynamic shared memory when it is
+ * resized on reload. Called before the ring is used. A reader pins the ring
+ * until the end of its transaction, so the worker doesn't free or overwrite
+ * it meanwhile.
+ */
+static void
+intervals_ring_attach(bool reader)
 {
-    HeapTuple role_tuple;
-    char* result;
-    role_tuple = SearchSysCache1(AUTHOID, ObjectIdGetDatum(user_oid));
-    if (HeapTupleIsValid(role_tuple))
-    {
-        result = pstrdup(NameStr(((Form_pg_authid) GETSTRUCT(role_tuple))->rolname));
-        ReleaseSysCache(role_tuple);
+#if PG_VERSION_NUM >= 100000
+    dsa_handle area_handle;
+    dsa_pointer pointer;
+    int tranche_id;
+    MemoryContext oldcontext;
+#endif
+    int count;
+    SpinLockAcquire(&global_variables->ring_mutex);
+    count = global_variables->actual_intervals_count;
+#if PG_VERSION_NUM >= 100000
+    area_handle = global_variables->ring_area_handle;
+    tranche_id = global_variables->ring_tranche_id;
+    pointer = global_variables->ring_pointer;
+    if (reader) {
+        if (ring_pinned)
+            intervals_ring_unpin_locked();
+        global_variables->ring_readers++;
+        pinned_ring_generation = global_variables->ring_generation;
+        ring_pinned = true;
     }
-    else
-        result = NULL;
-    return result;
+#else
+    (void) reader;
+#endif
+    SpinLockRelease(&global_variables->ring_mutex);
+#if PG_VERSION_NUM >= 100000
+    if (DsaPointerIsValid(pointer)) {
+        if (ring_area == NULL) {
+#if PG_VERSION_NUM < 190000
+            LWLockRegisterTranche(tranche_id, "logerrors");
+#else
+            (void) tranche_id;
+#endif
+            /* Mapping lives as long as the process */
+            oldcontext = MemoryContextSwitchTo(TopMemoryContext);
+            ring_area = dsa_attach(area_handle);
+            dsa_pin_mapping(ring_area);
+            MemoryContextSwitchTo(oldcontext);
+        }
+        intervals_buffer = dsa_get_address(ring_area, pointer);
+    } else
+        intervals_buffer = ring_place;
+#else
+    intervals_buffer = ring_place;
+#endif
+    ring_intervals_count = count;
+}
+
+static int
+get_tier_buckets_count(int tier_index)
+{
+    return tier_index == 0 ? minute_buckets : hour_buckets;
+}
+
+static Size
+tiers_buffer_size(void)
+{
+    Size size;
+    int i;
+    size = MAXALIGN(sizeof(RollupTier) * rollup_tiers_count);
+    for (i = 0; i < rollup_tiers_count; ++i)
+        size = add_size(size, mul_size(get_tier_buckets_count(i), interval_counters_size(tier_slots)));
+    return size;
+}
+
+static RollupTier *
+get_rollup_tier(int tier_index)
+{
+    return &((RollupTier *) tiers_buffer)[tier_index];
 }
 
+static IntervalCounters *
+get_tier_bucket(int tier_index, int bucket_index)
+{
+    RollupTier *tier = get_rollup_tier(tier_index);
+    return (IntervalCounters *) (tiers_buffer + tier->offset + bucket_index * tier->bucket_size);
+}
 
 static void
-logerrors_init(void)
+rollup_tiers_init(void)
 {
-    bool found;
-    ErrorCode key;
-    ErrorName* err_name;
+    RollupTier *tier;
+    Size offset = MAXALIGN(sizeof(RollupTier) * rollup_tiers_count);
     int i;
-    for (i = 0; i < error_codes_count; ++i) {
-        key.num = error_codes[i];
-        err_name = hash_search(error_names_hashtable, (void *) &key, HASH_ENTER, &found);
-        err_name->name = (char*)error_names[i];
-    }
-    pg_atomic_init_u64(&global_variables->messagesBuffer.current_message_index, 0);
-    pg_atomic_init_u64(&global_variables->messagesBuffer.current_interval_index, 0);
-    MemSet(&global_variables->total_count, 0, message_types_count);
-    for (i = 0; i < message_types_count; ++i) {
-        pg_atomic_init_u32(&global_variables->total_count[i], 0);
+    int j;
+    for (i = 0; i < rollup_tiers_count; ++i) {
+        tier = get_rollup_tier(i);
+        tier->buckets_count = get_tier_buckets_count(i);
+        tier->offset = offset;
+        tier->bucket_size = interval_counters_size(tier_slots);
+        pg_atomic_init_u64(&tier->current_bucket, 0);
+        offset += tier->buckets_count * tier->bucket_size;
+        for (j = 0; j < tier->buckets_count; ++j)
+            interval_counters_init(get_tier_bucket(i, j), tier_slots);
     }
-    for (i = 0; i < messages_per_interval * global_variables->actual_intervals_count; ++i) {
-        global_variables->messagesBuffer.buffer[i].error_code = -1;
-        global_variables->messagesBuffer.buffer[i].db_oid = -1;
-        global_variables->messagesBuffer.buffer[i].user_oid = -1;
-        global_variables->messagesBuffer.buffer[i].message_type_index = -1;
+}
+
+static inline uint32
+errcode_hash(int sqlerrcode)
+{
+    uint32 hash;
+    hash = (uint32) sqlerrcode * 0x9E3779B1;
+    hash ^= hash >> 16;
+    return hash & (filter_index_size - 1);
+}
+
+/* Parse comma separated SQLSTATEs, "57***" stands for the whole class 57 */
+/*
+ * Is it a SQLSTATE of five digits or upper case letters, or a class like
+ * "57***" if whole_class is allowed
+ */
+static bool
+sqlstate_is_valid(const char *str, bool whole_class)
+{
+    int chars = len_sqlstate_str;
+    int i;
+    if (strlen(str) != len_sqlstate_str)
+        return false;
+    if (whole_class && strcmp(str + 2, "***") == 0)
+        chars = 2;
+    for (i = 0; i < chars; ++i) {
+        if (!((str[i] >= '0' && str[i] <= '9') || (str[i] >= 'A' && str[i] <= 'Z')))
+            return false;
     }
-    slow_log_info_init();
+    return true;
 }
 
 static void
-logerrors_update_info(void)
+errcodes_list_parse(const char *list_str, const char *guc_name, ErrcodesList *list)
 {
+    char *copy;
+    char *item;
+    char *end;
     int i;
-    int current_interval;
-    if (global_variables == NULL) {
+    list->count = 0;
+    if (list_str == NULL)
         return;
+    copy = pstrdup(list_str);
+    for (item = strtok(copy, ","); item != NULL; item = strtok(NULL, ",")) {
+        while (*item == ' ' || *item == '\t')
+            item++;
+        end = item + strlen(item);
+        while (end > item && (end[-1] == ' ' || end[-1] == '\t'))
+            end--;
+        *end = '\0';
+        if (*item == '\0')
+            continue;
+        if (strlen(item) != len_sqlstate_str) {
+            elog(WARNING, "logerrors: errcode length should be equal to %d", len_sqlstate_str);
+            continue;
+        }
+        for (i = 0; i < len_sqlstate_str; ++i)
+            item[i] = pg_toupper((unsigned char) item[i]);
+        if (!sqlstate_is_valid(item, true)) {
+            elog(WARNING, "logerrors: errcode \"%s\" in %s should be digits and letters or a whole class like \"57***\"",
+                 item, guc_name);
+            continue;
+        }
+        if (list->count == max_filter_codes) {
+            elog(WARNING, "logerrors: only first %d errcodes of %s are used", max_filter_codes, guc_name);
+            break;
+        }
+        if (strcmp(item + 2, "***") == 0) {
+            list->codes[list->count] = MAKE_SQLSTATE(item[0], item[1], '0', '0', '0');
+            list->whole_class[list->count] = true;
+        } else {
+            list->codes[list->count] = MAKE_SQLSTATE(item[0], item[1], item[2], item[3], item[4]);
+            list->whole_class[list->count] = false;
+        }
+        list->count++;
     }
-    current_interval = (pg_atomic_read_u64(&global_variables->messagesBuffer.current_interval_index) + (uint64)1) %
-            (uint64)global_variables->actual_intervals_count;
-    for (i = 0; i < messages_per_interval; ++i) {
-        global_variables->messagesBuffer.buffer[i + current_interval * messages_per_interval].error_code = -1;
-        global_variables->messagesBuffer.buffer[i + current_interval * messages_per_interval].db_oid = -1;
-        global_variables->messagesBuffer.buffer[i + current_interval * messages_per_interval].user_oid = -1;
-        global_variables->messagesBuffer.buffer[i + current_interval * messages_per_interval].message_type_index = -1;
-    }
-    pg_atomic_write_u64(&global_variables->messagesBuffer.current_message_index, 0);
-    // no locking is required as this is the only place where the current_interval_index changes
-    pg_atomic_write_u64(&global_variables->messagesBuffer.current_interval_index, current_interval);
+    pfree(copy);
 }
 
-void
-logerrors_main(Datum main_arg)
+static bool
+errcodes_list_contains(const ErrcodesList *list, int sqlerrcode)
 {
-    /* Register functions for SIGTERM management */
-    pqsignal(SIGTERM, logerrors_sigterm);
+    int i;
+    for (i = 0; i < list->count; ++i) {
+        if (list->whole_class[i] ? list->codes[i] == ERRCODE_TO_CATEGORY(sqlerrcode)
+                                 : list->codes[i] == sqlerrcode)
+            return true;
+    }
+    return false;
+}
 
-    /* We're now ready to receive signals */
+static void
+errcodes_filter_add_exception(ErrcodesFilter *filter, int sqlerrcode)
+{
+    uint32 slot;
+    slot = errcode_hash(sqlerrcode);
+    while (filter->codes[slot] != -1) {
+        if (filter->codes[slot] == sqlerrcode)
+            return;
+        slot = (slot + 1) & (filter_index_size - 1);
+    }
+    filter->codes[slot] = sqlerrcode;
+    filter->classes[ERRCODE_TO_CATEGORY(sqlerrcode)] |= filter_class_has_exceptions;
+}
+
+/*
+ * A message is counted if logerrors.included_errcodes is empty or contains
+ * its code, and neither logerrors.excluded_errcodes nor built-in excluded
+ * codes contain it. Only the worker and the postmaster build the filter.
+ */
+static void
+errcodes_filter_build(void)
+{
+    ErrcodesList included;
+    ErrcodesList excluded;
+    ErrcodesFilter *filter;
+    uint32 next_filter;
+    int i;
+    int code;
+    bool counted;
+
+    errcodes_list_parse(included_errcodes_str, "logerrors.included_errcodes", &included);
+    errcodes_list_parse(excluded_errcodes_str, "logerrors.excluded_errcodes", &excluded);
+    for (i = 0; i < sizeof(excluded_errcodes) / sizeof(excluded_errcodes[0]); ++i) {
+        if (excluded.count == max_filter_codes)
+            break;
+        excluded.codes[excluded.count] = excluded_errcodes[i];
+        excluded.whole_class[excluded.count] = false;
+        excluded.count++;
+    }
+
+    next_filter = 1 - (pg_atomic_read_u32(&global_variables->filter_generation) & 1);
+    filter = &global_variables->filters[next_filter];
+    memset(filter->classes, included.count > 0 ? 0 : filter_class_counted, sizeof(filter->classes));
+    memset(filter->codes, -1, sizeof(filter->codes));
+    for (i = 0; i < included.count; ++i) {
+        if (included.whole_class[i])
+            filter->classes[included.codes[i]] = filter_class_counted;
+    }
+    for (i = 0; i < excluded.count; ++i) {
+        if (excluded.whole_class[i])
+            filter->classes[excluded.codes[i]] = 0;
+    }
+    /* Codes listed one by one are exceptions if their verdict differs from class */
+    for (i = 0; i < included.count + excluded.count; ++i) {
+        if (i < included.count ? included.whole_class[i] : excluded.whole_class[i - included.count])
+            continue;
+        code = i < included.count ? included.codes[i] : excluded.codes[i - included.count];
+        counted = (included.count == 0 || errcodes_list_contains(&included, code)) &&
+                  !errcodes_list_contains(&excluded, code);
+        if (counted != ((filter->classes[ERRCODE_TO_CATEGORY(code)] & filter_class_counted) != 0))
+            errcodes_filter_add_exception(filter, code);
+    }
+    /*
+     * Filter must be filled before the hook sees it. The increment is a full
+     * barrier, so the next build writes only after it is seen too.
+     */
+    pg_write_barrier();
+    pg_atomic_fetch_add_u32(&global_variables->filter_generation, 1);
+}
+
+/* Verdict of one filter, may be torn if the worker rebuilds it meanwhile */
+static bool
+errcodes_filter_probe(const ErrcodesFilter *filter, int sqlerrcode)
+{
+    uint8 class_verdict;
+    uint32 slot;
+    uint32 probes;
+    bool counted;
+    class_verdict = filter->classes[ERRCODE_TO_CATEGORY(sqlerrcode)];
+    counted = (class_verdict & filter_class_counted) != 0;
+    if (!(class_verdict & filter_class_has_exceptions))
+        return counted;
+    slot = errcode_hash(sqlerrcode);
+    /* A torn table may have no empty slot */
+    for (probes = 0; probes < filter_index_size && filter->codes[slot] != -1; ++probes) {
+        if (filter->codes[slot] == sqlerrcode)
+            return !counted;
+        slot = (slot + 1) & (filter_index_size - 1);
+    }
+    return counted;
+}
+
+/* Does the hook count messages with the code, one or two lookups whatever lists are */
+static bool
+errcodes_filter_counts(int sqlerrcode)
+{
+    uint32 generation;
+    bool counted;
+    do {
+        generation = pg_atomic_read_u32(&global_variables->filter_generation);
+        pg_read_barrier();
+        counted = errcodes_filter_probe(&global_variables->filters[generation & 1], sqlerrcode);
+        pg_read_barrier();
+    } while (pg_atomic_read_u32(&global_variables->filter_generation) != generation);
+    return counted;
+}
+
+/* Parse logerrors.dimensions, only the worker and the postmaster call it */
+static void
+dimensions_build(void)
+{
+    char *copy;
+    char *item;
+    char *end;
+    uint32 dimensions = 0;
+    if (dimensions_str != NULL) {
+        copy = pstrdup(dimensions_str);
+        for (item = strtok(copy, ","); item != NULL; item = strtok(NULL, ",")) {
+            while (*item == ' ' || *item == '\t')
+                item++;
+            end = item + strlen(item);
+            while (end > item && (end[-1] == ' ' || end[-1] == '\t'))
+                end--;
+            *end = '\0';
+            if (*item == '\0')
+                continue;
+            if (pg_strcasecmp(item, "application_name") == 0)
+                dimensions |= dimension_application_name;
+            else if (pg_strcasecmp(item, "backend_type") == 0)
+                dimensions |= dimension_backend_type;
+            else if (pg_strcasecmp(item, "client_addr") == 0)
+                dimensions |= dimension_client_addr;
+            else
+                elog(WARNING, "logerrors: unknown dimension \"%s\" in logerrors.dimensions", item);
+        }
+        pfree(copy);
+    }
+    pg_atomic_write_u32(&global_variables->dimensions, dimensions);
+}
+
+static void
+global_variables_init(void)
+{
+    /* Until the worker resizes the ring, if intervals_count has grown since the memory was requested */
+    global_variables->intervals_count = Min(intervals_count, ring_place_count - 5);
+    global_variables->actual_intervals_count = ring_place_count;
+    global_variables->ring_place_count = ring_place_count;
+#if PG_VERSION_NUM >= 100000
+    global_variables->ring_area_created = false;
+    global_variables->ring_pointer = InvalidDsaPointer;
+    global_variables->old_ring_pointer = InvalidDsaPointer;
+    global_variables->ring_generation = 0;
+    global_variables->ring_readers = 0;
+    global_variables->old_ring_readers = 0;
+#endif
+    SpinLockInit(&global_variables->ring_mutex);
+    global_variables->interval = interval;
+    global_variables->interval_slots = interval_slots;
+    global_variables->window_slots = get_window_slots();
+    global_variables->messagesBuffer.interval_size = interval_counters_size(interval_slots);
+    global_variables->backends_count = get_backends_count();
+
+    pg_atomic_init_u64(&global_variables->messagesBuffer.last_sequence, 0);
+    pg_atomic_init_u32(&global_variables->filter_generation, 0);
+    pg_atomic_init_u32(&global_variables->slow_log_info.count, 0);
+    pg_atomic_init_u64(&global_variables->slow_log_info.reset_time, 0);
+    pg_atomic_init_u64(&global_variables->reset_epoch, 0);
+    pg_atomic_init_u64(&global_variables->applied_reset_epoch, 0);
+    pg_atomic_init_u32(&global_variables->dimensions, 0);
+    pg_atomic_init_u64(&global_variables->clock_offset, 0);
+    pg_atomic_init_u64(&global_variables->requested_ticks, 0);
+    pg_atomic_init_u64(&global_variables->done_ticks, 0);
+    global_variables->worker_latch = NULL;
+    pg_atomic_init_u64(&global_variables->internal_stats.ticks_count, 0);
+    pg_atomic_init_u64(&global_variables->internal_stats.tick_lag_us, 0);
+    pg_atomic_init_u64(&global_variables->internal_stats.tick_lag_max_us, 0);
+    pg_atomic_init_u64(&global_variables->internal_stats.tick_time_us, 0);
+    pg_atomic_init_u64(&global_variables->internal_stats.scan_time_us, 0);
+    pg_atomic_init_u64(&global_variables->internal_stats.scan_entries, 0);
+    errcodes_filter_build();
+    dimensions_build();
+}
+
+/*
+ * Forget slow log, on start and by the worker on reset. Generation is odd
+ * while histograms are cleared, so backends don't add new ones meanwhile;
+ * the mutex is held only to switch it.
+ */
+static void
+slow_log_info_init(void)
+{
+    int i;
+    int j;
+    pg_atomic_write_u32(&global_variables->slow_log_info.count, 0);
+    pg_atomic_write_u64(&global_variables->slow_log_info.reset_time, logerrors_now());
+    SpinLockAcquire(&slow_log_histograms->mutex);
+    pg_atomic_fetch_add_u32(&slow_log_histograms->generation, 1);
+    pg_atomic_write_u32(&slow_log_histograms->used_count, 0);
+    SpinLockRelease(&slow_log_histograms->mutex);
+    for (i = 0; i <= slow_log_histograms_count; ++i) {
+        slow_log_histograms->histograms[i].db_oid = InvalidOid;
+        slow_log_histograms->histograms[i].user_oid = InvalidOid;
+        for (j = 0; j < slow_log_buckets_count; ++j)
+            pg_atomic_write_u32(&slow_log_histograms->histograms[i].buckets[j], 0);
+    }
+    pg_write_barrier();
+    pg_atomic_fetch_add_u32(&slow_log_histograms->generation, 1);
+}
+
+static void
+slow_log_histograms_init(void)
+{
+    int i;
+    int j;
+    SpinLockInit(&slow_log_histograms->mutex);
+    pg_atomic_init_u32(&slow_log_histograms->used_count, 0);
+    pg_atomic_init_u32(&slow_log_histograms->generation, 0);
+    for (i = 0; i <= slow_log_histograms_count; ++i) {
+        for (j = 0; j < slow_log_buckets_count; ++j)
+            pg_atomic_init_u32(&slow_log_histograms->histograms[i].buckets[j], 0);
+    }
+}
+
+/*
+ * Parse duration of messages like "duration: 1234.567 ms  statement: ..."
+ * into microseconds. Other messages are rejected by their first character
+ * in most cases.
+ */
+static bool
+parse_duration_message(const char *message, uint64 *duration_us)
+{
+    const char *c;
+    uint64 ms = 0;
+    uint64 fraction = 0;
+    int fraction_digits = 0;
+    if (message[0] != duration_prefix[0] || strncmp(message, duration_prefix, duration_prefix_len) != 0)
+        return false;
+    c = message + duration_prefix_len;
+    if (*c < '0' || *c > '9')
+        return false;
+    /* Longer than max of histogram anyway */
+    for (; *c >= '0' && *c <= '9'; ++c) {
+        if (ms < PG_INT64_MAX / 10000)
+            ms = ms * 10 + (*c - '0');
+    }
+    if (*c == '.') {
+        for (++c; *c >= '0' && *c <= '9'; ++c) {
+            if (fraction_digits < 3) {
+                fraction = fraction * 10 + (*c - '0');
+                fraction_digits++;
+            }
+        }
+    }
+    for (; fraction_digits < 3; ++fraction_digits)
+        fraction *= 10;
+    *duration_us = ms * 1000 + fraction;
+    return true;
+}
+
+/* Bucket of the duration, its width is at most 1/8 of durations in it */
+static int
+slow_log_bucket(uint64 duration_us)
+{
+    int shift = 0;
+    int bucket;
+    if (duration_us < slow_log_sub_buckets)
+        return (int) duration_us;
+    while ((duration_us >> shift) >= 2 * slow_log_sub_buckets)
+        shift++;
+    bucket = (shift + 1) * slow_log_sub_buckets + (int) (duration_us >> shift) - slow_log_sub_buckets;
+    return Min(bucket, slow_log_buckets_count - 1);
+}
+
+static uint64
+slow_log_bucket_lower(int bucket)
+{
+    if (bucket < slow_log_sub_buckets)
+        return bucket;
+    return (uint64) (slow_log_sub_buckets + bucket % slow_log_sub_buckets) << (bucket / slow_log_sub_buckets - 1);
+}
+
+static uint64
+slow_log_bucket_upper(int bucket)
+{
+    if (bucket < slow_log_sub_buckets)
+        return bucket + 1;
+    return slow_log_bucket_lower(bucket) + ((uint64) 1 << (bucket / slow_log_sub_buckets - 1));
+}
+
+/* NULL while the worker clears histograms on reset */
+static SlowLogHistogram *
+get_slow_log_histogram(Oid db_oid, Oid user_oid)
+{
+    SlowLogHistogram *histograms = slow_log_histograms->histograms;
+    uint32 generation;
+    uint32 used_count;
+    uint32 i;
+
+    generation = pg_atomic_read_u32(&slow_log_histograms->generation);
+    if (generation % 2 != 0)
+        return NULL;
+    if (cached_histogram >= 0 && cached_histogram_generation == generation &&
+        cached_histogram_db_oid == db_oid && cached_histogram_user_oid == user_oid)
+        return &histograms[cached_histogram];
+
+    used_count = pg_atomic_read_u32(&slow_log_histograms->used_count);
+    pg_read_barrier();
+    for (i = 0; i < used_count; ++i) {
+        if (histograms[i].db_oid == db_oid && histograms[i].user_oid == user_oid)
+            break;
+    }
+    if (i == used_count) {
+        SpinLockAcquire(&slow_log_histograms->mutex);
+        if (pg_atomic_read_u32(&slow_log_histograms->generation) != generation) {
+            SpinLockRelease(&slow_log_histograms->mutex);
+            return NULL;
+        }
+        /* Somebody else could add it meanwhile */
+        used_count = pg_atomic_read_u32(&slow_log_histograms->used_count);
+        for (i = 0; i < used_count; ++i) {
+            if (histograms[i].db_oid == db_oid && histograms[i].user_oid == user_oid)
+                break;
+        }
+        if (i == used_count && used_count < slow_log_histograms_count) {
+            histograms[i].db_oid = db_oid;
+            histograms[i].user_oid = user_oid;
+            /* Key must be filled before others see it */
+            pg_write_barrier();
+            pg_atomic_write_u32(&slow_log_histograms->used_count, used_count + 1);
+        }
+        SpinLockRelease(&slow_log_histograms->mutex);
+    }
+    cached_histogram = i;
+    cached_histogram_db_oid = db_oid;
+    cached_histogram_user_oid = user_oid;
+    cached_histogram_generation = generation;
+    return &histograms[i];
+}
+
+static void
+sources_init(void)
+{
+    SpinLockInit(&sources->mutex);
+    memset(sources->entries, 0, sizeof(sources->entries));
+    sources->entries[0].backend_type = -1;
+    sources->entries[sources_count].backend_type = -1;
+    pg_atomic_init_u32(&sources->used_count, 1);
+}
+
+/*
+ * Number of the source of this backend in Sources, it is added if there is
+ * no such source yet. Only a change of dimensions or application name makes
+ * the backend look it up again.
+ */
+static uint32
+get_own_source(void)
+{
+    Source *entries = sources->entries;
+    Source key;
+    const char *app_name;
+    uint32 dimensions;
+    uint32 used_count;
+    uint32 i;
+
+    dimensions = pg_atomic_read_u32(&global_variables->dimensions);
+    if (dimensions == 0)
+        return 0;
+    app_name = (dimensions & dimension_application_name) && application_name != NULL ? application_name : "";
+    if (cached_source >= 0 && cached_source_dimensions == dimensions &&
+        strncmp(cached_source_application_name, app_name, NAMEDATALEN - 1) == 0)
+        return cached_source;
+
+    memset(&key, 0, sizeof(key));
+    strlcpy(key.application_name, app_name, NAMEDATALEN);
+    key.backend_type = -1;
+#if PG_VERSION_NUM >= 130000
+    if (dimensions & dimension_backend_type)
+        key.backend_type = (int) MyBackendType;
+#endif
+    if ((dimensions & dimension_client_addr) && MyProcPort != NULL && MyProcPort->remote_host != NULL)
+        strlcpy(key.client_addr, MyProcPort->remote_host, source_client_addr_len);
+
+    used_count = pg_atomic_read_u32(&sources->used_count);
+    pg_read_barrier();
+    for (i = 0; i < used_count; ++i) {
+        if (memcmp(&entries[i], &key, sizeof(Source)) == 0)
+            break;
+    }
+    if (i == used_count) {
+        SpinLockAcquire(&sources->mutex);
+        /* Somebody else could add it meanwhile */
+        used_count = pg_atomic_read_u32(&sources->used_count);
+        for (i = 0; i < used_count; ++i) {
+            if (memcmp(&entries[i], &key, sizeof(Source)) == 0)
+                break;
+        }
+        if (i == used_count) {
+            if (used_count < sources_count) {
+                entries[i] = key;
+                /* Source must be filled before others see it */
+                pg_write_barrier();
+                pg_atomic_write_u32(&sources->used_count, used_count + 1);
+            } else
+                i = sources_count;
+        }
+        SpinLockRelease(&sources->mutex);
+    }
+    cached_source = i;
+    cached_source_dimensions = dimensions;
+    strlcpy(cached_source_application_name, app_name, NAMEDATALEN);
+    return i;
+}
+
+static inline uint32
+message_info_hash(const MessageInfo *key)
+{
+    uint32 hash;
+    hash = (uint32) key->error_code;
+    hash = (hash * 0x9E3779B1) ^ key->db_oid;
+    hash = (hash * 0x9E3779B1) ^ key->user_oid;
+    hash = (hash * 0x9E3779B1) ^ (uint32) key->message_type_index;
+    hash = (hash * 0x9E3779B1) ^ key->source;
+    hash ^= hash >> 16;
+    hash *= 0x85EBCA6B;
+    hash ^= hash >> 13;
+    return hash;
+}
+
+static inline uint32
+message_key_hash(const MessageKey *key)
+{
+    uint32 hash;
+    hash = key->code;
+    hash = (hash * 0x9E3779B1) ^ key->principal;
+    hash ^= hash >> 16;
+    hash *= 0x85EBCA6B;
+    hash ^= hash >> 13;
+    return hash;
+}
+
+static void
+principals_init(void)
+{
+    pg_atomic_init_u32(&principals->used_count, 0);
+    memset(principals->index, 0, sizeof(principals->index));
+    principals->entries[principals_count].db_oid = InvalidOid;
+    principals->entries[principals_count].user_oid = InvalidOid;
+    principals->entries[principals_count].source = 0;
+}
+
+/*
+ * Number of the database, user and source in Principals, they are added if
+ * there is no such principal yet. Only the worker calls it, and the
+ * postmaster on load.
+ */
+static uint32
+principals_lookup(Oid db_oid, Oid user_oid, uint32 source)
+{
+    uint32 mask = principals_count * 2 - 1;
+    uint32 slot;
+    uint32 used_count;
+    Principal *principal;
+
+    slot = (db_oid * 0x9E3779B1) ^ user_oid;
+    slot = (slot * 0x9E3779B1) ^ source;
+    slot ^= slot >> 16;
+    slot = (slot * 0x85EBCA6B) & mask;
+    while (principals->index[slot] != 0) {
+        principal = &principals->entries[principals->index[slot] - 1];
+        if (principal->db_oid == db_oid && principal->user_oid == user_oid && principal->source == source)
+            return principals->index[slot] - 1;
+        slot = (slot + 1) & mask;
+    }
+    used_count = pg_atomic_read_u32(&principals->used_count);
+    if (used_count >= principals_count)
+        return principals_count;
+    principal = &principals->entries[used_count];
+    principal->db_oid = db_oid;
+    principal->user_oid = user_oid;
+    principal->source = source;
+    principals->index[slot] = used_count + 1;
+    /* Principal must be filled before any interval refers to it */
+    pg_write_barrier();
+    pg_atomic_write_u32(&principals->used_count, used_count + 1);
+    return used_count;
+}
+
+static void
+message_key_pack(const MessageInfo *info, MessageKey *key)
+{
+    key->code = (uint32) info->error_code | ((uint32) info->message_type_index << 30);
+    key->principal = principals_lookup(info->db_oid, info->user_oid, info->source);
+}
+
+static void
+message_key_unpack(const MessageKey *key, MessageInfo *info)
+{
+    const Principal *principal = &principals->entries[Min(key->principal, principals_count)];
+    info->error_code = message_key_error_code(*key);
+    info->message_type_index = message_key_type_index(*key);
+    info->db_oid = principal->db_oid;
+    info->user_oid = principal->user_oid;
+    info->source = principal->source;
+}
+
+static void
+interval_counters_clear(IntervalCounters *counters)
+{
+    int i;
+    pg_atomic_write_u32(&counters->entries_count, 0);
+    for (i = 0; i < message_types_count; ++i)
+        pg_atomic_write_u32(&counters->overflow_count[i], 0);
+    memset(interval_counters_index(counters), 0, sizeof(uint16) * counters->index_size);
+}
+
+static void
+interval_counters_init(IntervalCounters *counters, int slots)
+{
+    counters->slots = slots;
+    counters->index_size = interval_index_size(slots);
+    pg_atomic_init_u32(&counters->change_count, 0);
+    pg_atomic_init_u64(&counters->start_time, 0);
+    pg_atomic_init_u64(&counters->end_time, 0);
+    pg_atomic_init_u64(&counters->sequence, 0);
+    interval_counters_clear(counters);
+}
+
+/* Readers retry a copy which overlaps begin and end of a change */
+static inline void
+interval_counters_begin_change(IntervalCounters *counters)
+{
+    pg_atomic_write_u32(&counters->change_count, pg_atomic_read_u32(&counters->change_count) + 1);
+    pg_write_barrier();
+}
+
+static inline void
+interval_counters_end_change(IntervalCounters *counters)
+{
+    pg_write_barrier();
+    pg_atomic_write_u32(&counters->change_count, pg_atomic_read_u32(&counters->change_count) + 1);
+}
+
+/* Forget counters and times of the interval, only the worker calls it */
+static void
+interval_counters_reset(IntervalCounters *counters)
+{
+    interval_counters_begin_change(counters);
+    pg_atomic_write_u64(&counters->end_time, 0);
+    pg_atomic_write_u64(&counters->start_time, 0);
+    pg_atomic_write_u64(&counters->sequence, 0);
+    interval_counters_clear(counters);
+    interval_counters_end_change(counters);
+}
+
+/*
+ * Find counter of the key in the interval, add it if there is no such key yet
+ * and add is true. Returns NULL if there is no such key or no free slots.
+ * Only the worker calls it.
+ */
+static CounterEntry *
+interval_counters_lookup(IntervalCounters *counters, const MessageKey *key, bool add)
+{
+    uint16 *index = interval_counters_index(counters);
+    CounterEntry *entries = interval_counters_entries(counters);
+    uint32 mask = counters->index_size - 1;
+    uint32 slot;
+    uint32 entries_count;
+    CounterEntry *entry;
+
+    slot = message_key_hash(key) & mask;
+    while (index[slot] != 0) {
+        entry = &entries[index[slot] - 1];
+        if (entry->key.code == key->code && entry->key.principal == key->principal)
+            return entry;
+        slot = (slot + 1) & mask;
+    }
+    entries_count = pg_atomic_read_u32(&counters->entries_count);
+    if (!add || entries_count >= counters->slots)
+        return NULL;
+    entry = &entries[entries_count];
+    entry->key = *key;
+    pg_atomic_init_u32(&entry->counter, 0);
+    interval_counters_estimated(counters)[entries_count] = 0;
+    index[slot] = entries_count + 1;
+    /* Entry must be filled before readers see it */
+    pg_write_barrier();
+    pg_atomic_write_u32(&counters->entries_count, entries_count + 1);
+    return entry;
+}
+
+static void
+interval_counters_add(IntervalCounters *counters, const MessageKey *key, uint32 count, uint16 estimated)
+{
+    CounterEntry *entry;
+    uint16 *entry_estimated;
+    entry = interval_counters_lookup(counters, key, true);
+    if (entry != NULL) {
+        pg_atomic_fetch_add_u32(&entry->counter, count);
+        entry_estimated = &interval_counters_estimated(counters)[entry - interval_counters_entries(counters)];
+        *entry_estimated = Min((uint32) *entry_estimated + estimated, PG_UINT16_MAX);
+    } else
+        pg_atomic_fetch_add_u32(&counters->overflow_count[message_key_type_index(*key)], count);
+}
+
+/*
+ * Add the interval to the window or subtract it from the window. Entries are
+ * never removed from the window until it is rebuilt, so a key which went to
+ * overflow stays there and is subtracted from overflow.
+ */
+static void
+window_apply_interval(IntervalCounters *counters, bool subtract)
+{
+    CounterEntry *entries = interval_counters_entries(counters);
+    uint16 *estimated = interval_counters_estimated(counters);
+    CounterEntry *window_entry;
+    uint16 *window_estimated;
+    uint32 entries_count;
+    uint32 count;
+    uint32 i;
+    entries_count = pg_atomic_read_u32(&counters->entries_count);
+    for (i = 0; i < entries_count; ++i) {
+        count = pg_atomic_read_u32(&entries[i].counter);
+        if (count == 0)
+            continue;
+        if (!subtract) {
+            interval_counters_add(window_counters, &entries[i].key, count, estimated[i]);
+            continue;
+        }
+        window_entry = interval_counters_lookup(window_counters, &entries[i].key, false);
+        if (window_entry != NULL) {
+            pg_atomic_fetch_sub_u32(&window_entry->counter, count);
+            window_estimated = &interval_counters_estimated(window_counters)[window_entry -
+                                                                              interval_counters_entries(window_counters)];
+            if (*window_estimated != PG_UINT16_MAX)
+                *window_estimated -= Min(*window_estimated, estimated[i]);
+        } else
+            pg_atomic_fetch_sub_u32(&window_counters->overflow_count[message_key_type_index(entries[i].key)], count);
+    }
+    for (i = 0; i < message_types_count; ++i) {
+        count = pg_atomic_read_u32(&counters->overflow_count[i]);
+        if (subtract)
+            pg_atomic_fetch_sub_u32(&window_counters->overflow_count[i], count);
+        else
+            pg_atomic_fetch_add_u32(&window_counters->overflow_count[i], count);
+    }
+}
+
+/* Count the window from scratch, ending with the closed interval */
+static void
+window_rebuild(int closed_interval)
+{
+    int i;
+    interval_counters_begin_change(window_counters);
+    interval_counters_clear(window_counters);
+    for (i = global_variables->intervals_count - 1; i >= 0; --i) {
+        window_apply_interval(get_interval_counters((closed_interval - i + ring_intervals_count)
+                                                    % ring_intervals_count), false);
+    }
+    interval_counters_end_change(window_counters);
+}
+
+/* Rebuild drops keys gone from the window, do it when they take a quarter of slots */
+static bool
+window_needs_rebuild(void)
+{
+    CounterEntry *entries = interval_counters_entries(window_counters);
+    uint32 entries_count;
+    uint32 i;
+    int unused_count = 0;
+    entries_count = pg_atomic_read_u32(&window_counters->entries_count);
+    if (entries_count < window_counters->slots * 3 / 4)
+        return false;
+    for (i = 0; i < entries_count; ++i) {
+        if (pg_atomic_read_u32(&entries[i].counter) == 0)
+            unused_count++;
+    }
+    return unused_count >= window_counters->slots / 4;
+}
+
+/*
+ * Apply interval and intervals_count after reload. If the ring needs another
+ * count of intervals, the latest ones are copied to a new ring in dynamic
+ * shared memory, or back to the fixed one if they fit there. Only the worker
+ * calls it.
+ */
+static void
+intervals_ring_resize(void)
+{
+    int current_interval;
+    bool count_changed = (intervals_count != global_variables->intervals_count);
+#if PG_VERSION_NUM >= 100000
+    int new_count;
+    int kept_count;
+    int i;
+    int old_ring_readers;
+    dsa_pointer new_pointer = InvalidDsaPointer;
+    char *new_buffer;
+    Size interval_size = global_variables->messagesBuffer.interval_size;
+
+    ring_resize_postponed = false;
+#endif
+
+    if (interval == global_variables->interval && !count_changed)
+        return;
+    current_interval = pg_atomic_read_u64(&global_variables->messagesBuffer.current_interval_index) %
+            (uint64)ring_intervals_count;
+#if PG_VERSION_NUM >= 100000
+    new_count = intervals_count + 5;
+    if (new_count != ring_intervals_count) {
+        /* The new ring may take place of the old one, wait until its readers are done */
+        SpinLockAcquire(&global_variables->ring_mutex);
+        old_ring_readers = global_variables->old_ring_readers;
+        SpinLockRelease(&global_variables->ring_mutex);
+        if (old_ring_readers > 0) {
+            ring_resize_postponed = true;
+            return;
+        }
+        if (DsaPointerIsValid(global_variables->old_ring_pointer)) {
+            dsa_free(ring_area, global_variables->old_ring_pointer);
+            global_variables->old_ring_pointer = InvalidDsaPointer;
+        }
+        if (new_count <= global_variables->ring_place_count && DsaPointerIsValid(global_variables->ring_pointer))
+            new_buffer = ring_place;
+        else {
+            if (!global_variables->ring_area_created) {
+#if PG_VERSION_NUM >= 190000
+                global_variables->ring_tranche_id = LWLockNewTrancheId("logerrors");
+#else
+                global_variables->ring_tranche_id = LWLockNewTrancheId();
+                LWLockRegisterTranche(global_variables->ring_tranche_id, "logerrors");
+#endif
+                ring_area = dsa_create(global_variables->ring_tranche_id);
+                dsa_pin(ring_area);
+                dsa_pin_mapping(ring_area);
+                global_variables->ring_area_handle = dsa_get_handle(ring_area);
+                global_variables->ring_area_created = true;
+            }
+            new_pointer = dsa_allocate_extended(ring_area, mul_size(new_count, interval_size), DSA_ALLOC_NO_OOM);
+            if (!DsaPointerIsValid(new_pointer)) {
+                ereport(WARNING,
+                        (errcode(ERRCODE_OUT_OF_MEMORY),
+                                errmsg("logerrors could not allocate %d intervals, keeping %d",
+                                       intervals_count, global_variables->intervals_count)));
+                return;
+            }
+            new_buffer = dsa_get_address(ring_area, new_pointer);
+        }
+        /* Latest intervals keep their order, the current one goes last */
+        kept_count = Min(ring_intervals_count, new_count);
+        for (i = 0; i < kept_count; ++i)
+            memcpy(new_buffer + i * interval_size,
+                   get_interval_counters((current_interval - (kept_count - 1) + i + ring_intervals_count)
+                                         % ring_intervals_count),
+                   interval_size);
+        for (i = kept_count; i < new_count; ++i)
+            interval_counters_init((IntervalCounters *) (new_buffer + i * interval_size),
+                                   global_variables->interval_slots);
+        current_interval = kept_count - 1;
+    }
+#endif
+    SpinLockAcquire(&global_variables->ring_mutex);
+    global_variables->interval = interval;
+    global_variables->intervals_count = intervals_count;
+#if PG_VERSION_NUM >= 100000
+    global_variables->actual_intervals_count = new_count;
+    if (new_count != ring_intervals_count) {
+        /* Readers of the current ring become readers of the old one */
+        global_variables->old_ring_pointer = global_variables->ring_pointer;
+        global_variables->old_ring_readers = global_variables->ring_readers;
+        global_variables->ring_readers = 0;
+        global_variables->ring_generation++;
+        global_variables->ring_pointer = new_pointer;
+    }
+#endif
+    SpinLockRelease(&global_variables->ring_mutex);
+    pg_atomic_write_u64(&global_variables->messagesBuffer.current_interval_index, current_interval);
+    intervals_ring_attach(false);
+    if (count_changed)
+        window_rebuild((current_interval - 1 + ring_intervals_count) % ring_intervals_count);
+}
+
+/*
+ * Free the ring replaced on resize once readers are done with it, and retry
+ * the resize which waited for them. Only the worker calls it.
+ */
+static void
+intervals_ring_free_old(void)
+{
+#if PG_VERSION_NUM >= 100000
+    int old_ring_readers;
+    SpinLockAcquire(&global_variables->ring_mutex);
+    old_ring_readers = global_variables->old_ring_readers;
+    SpinLockRelease(&global_variables->ring_mutex);
+    if (old_ring_readers > 0)
+        return;
+    if (DsaPointerIsValid(global_variables->old_ring_pointer)) {
+        dsa_free(ring_area, global_variables->old_ring_pointer);
+        global_variables->old_ring_pointer = InvalidDsaPointer;
+    }
+    if (ring_resize_postponed)
+        intervals_ring_resize();
+#endif
+}
+
+/*
+ * Weight the message is counted with, 0 if it is skipped. The first
+ * sample_threshold messages of a kind in an interval are counted one by one.
+ * Then 1 in N messages is counted with weight N, where N is the least power
+ * of two such that sample_threshold * N covers messages seen so far. So a
+ * backend counts about sample_threshold / 2 messages of a kind more each
+ * time their number doubles.
+ */
+static uint32
+message_sample_weight(const MessageInfo *key)
+{
+    SampledMessage *entry;
+    uint64 sequence;
+    uint32 weight;
+    if (sample_threshold == 0)
+        return 1;
+    sequence = pg_atomic_read_u64(&global_variables->messagesBuffer.last_sequence);
+    entry = &sampled_messages[message_info_hash(key) & (backend_slots * 2 - 1)];
+    if (entry->sequence != sequence || entry->seen_count == 0 ||
+        memcmp(&entry->key, key, sizeof(MessageInfo)) != 0) {
+        entry->key = *key;
+        entry->sequence = sequence;
+        entry->seen_count = 0;
+    }
+    entry->seen_count++;
+    if (entry->seen_count <= (uint32) sample_threshold)
+        return 1;
+    weight = 2;
+    while ((uint64) sample_threshold * weight < entry->seen_count)
+        weight *= 2;
+    return entry->seen_count % weight == 0 ? weight : 0;
+}
+
+/*
+ * BackendCounters of this backend's PGPROC slot, or the shared ones if it
+ * has no slot. Then shared is set and counters are changed atomically.
+ */
+static BackendCounters *
+get_own_backend_counters(bool *shared)
+{
+    int backend_index;
+#if PG_VERSION_NUM >= 170000
+    backend_index = MyProcNumber;
+#else
+    backend_index = MyProc->pgprocno;
+#endif
+    *shared = (backend_index < 0 || backend_index >= global_variables->backends_count);
+    if (*shared)
+        backend_index = global_variables->backends_count;
+    return get_backend_counters(backend_index);
+}
+
+/* Only the owner writes its counters, so it doesn't need a locked add */
+static inline void
+backend_counter_add(pg_atomic_uint64 *counter, uint64 value, bool shared)
+{
+    if (shared)
+        pg_atomic_fetch_add_u64(counter, value);
+    else
+        pg_atomic_write_u64(counter, pg_atomic_read_u64(counter) + value);
+}
+
+/* Forget messages counted since the last drain, called under mutex */
+static void
+backend_counters_clear(BackendCounters *counters)
+{
+    counters->used_count = 0;
+    memset(counters->index, 0, sizeof(counters->index));
+    memset(counters->overflow_count, 0, sizeof(counters->overflow_count));
+    memset(counters->class_count, 0, sizeof(counters->class_count));
+    counters->fingerprints_used = 0;
+    memset(counters->fingerprints_dropped, 0, sizeof(counters->fingerprints_dropped));
+}
+
+/*
+ * Count totals from zero after reset. Readers skip totals until the new
+ * epoch is written. Backends sharing the last slot may lose a few messages
+ * counted at the same moment.
+ */
+static void
+backend_totals_restart(BackendCounters *counters, uint64 reset_epoch)
+{
+    int j;
+    for (j = 0; j < message_types_count; ++j)
+        pg_atomic_write_u64(&counters->total_count[j], 0);
+    pg_write_barrier();
+    pg_atomic_write_u64(&counters->totals_epoch, reset_epoch);
+}
+
+static void
+add_message(BackendCounters *counters, bool shared, int err_code, Oid db_oid, Oid user_oid,
+            uint32 source, int message_type_index, ErrorData *edata) {
+    uint32 slot;
+    uint32 weight;
+    uint64 fingerprint;
+    uint64 reset_epoch;
+    int i;
+    MessageInfo key;
+    BackendCounter *counter;
+    FingerprintCounter *fingerprint_counter;
+    key.error_code = err_code;
+    key.db_oid = db_oid;
+    key.user_oid = user_oid;
+    key.message_type_index = message_type_index;
+    key.source = source;
+
+    reset_epoch = pg_atomic_read_u64(&global_variables->reset_epoch);
+    if (pg_atomic_read_u64(&counters->totals_epoch) != reset_epoch)
+        backend_totals_restart(counters, reset_epoch);
+    /* Totals and classes count every message, skipped by sampling too */
+    backend_counter_add(&counters->total_count[message_type_index], 1, shared);
+    weight = message_sample_weight(&key);
+    fingerprint = weight > 0 ? message_fingerprint(edata, message_type_index) : 0;
+
+    SpinLockAcquire(&counters->mutex);
+    /* Messages counted before reset must not go to statistics after it */
+    if (counters->epoch != reset_epoch) {
+        backend_counters_clear(counters);
+        counters->epoch = reset_epoch;
+    }
+    counters->class_count[message_type_index][error_class_index[ERRCODE_TO_CATEGORY(err_code)]]++;
+    if (weight == 0) {
+        SpinLockRelease(&counters->mutex);
+        backend_counter_add(&counters->sampled_out_count, 1, shared);
+        return;
+    }
+    slot = message_info_hash(&key) & (backend_slots * 2 - 1);
+    for (;;) {
+        if (counters->index[slot] == 0) {
+            if (counters->used_count >= backend_slots) {
+                counters->overflow_count[message_type_index] += weight;
+                break;
+            }
+            counter = &counters->counters[counters->used_count];
+            counter->key = key;
+            counter->counter = weight;
+            counter->estimated = (weight > 1);
+            counters->used_count++;
+            counters->index[slot] = counters->used_count;
+            break;
+        }
+        counter = &counters->counters[counters->index[slot] - 1];
+        if (memcmp(&counter->key, &key, sizeof(MessageInfo)) == 0) {
+            counter->counter += weight;
+            counter->estimated |= (weight > 1);
+            break;
+        }
+        slot = (slot + 1) & (backend_slots * 2 - 1);
+    }
+    for (i = 0; i < counters->fingerprints_used; ++i) {
+        if (counters->fingerprints[i].fingerprint == fingerprint)
+            break;
+    }
+    if (i < counters->fingerprints_used)
+        counters->fingerprints[i].counter += weight;
+    else if (counters->fingerprints_used < backend_fingerprint_slots) {
+        fingerprint_counter = &counters->fingerprints[counters->fingerprints_used++];
+        fingerprint_counter->fingerprint = fingerprint;
+        fingerprint_counter->counter = weight;
+        fingerprint_counter->error_code = err_code;
+        fingerprint_counter->message_type_index = message_type_index;
+        strlcpy(fingerprint_counter->sample, edata->message != NULL ? edata->message : "",
+                fingerprint_sample_len);
+    } else
+        counters->fingerprints_dropped[message_type_index] += weight;
+    SpinLockRelease(&counters->mutex);
+}
+
+/* Count messages of a fingerprint in the Space-Saving summary, only the worker calls it */
+static void
+heavy_hitters_add(const FingerprintCounter *fingerprint_counter)
+{
+    HeavyHitter *entry = NULL;
+    int i;
+    SpinLockAcquire(&heavy_hitters->mutex);
+    for (i = 0; i < heavy_hitters->used_count; ++i) {
+        if (heavy_hitters->entries[i].fingerprint == fingerprint_counter->fingerprint) {
+            entry = &heavy_hitters->entries[i];
+            break;
+        }
+    }
+    if (entry == NULL) {
+        if (heavy_hitters->used_count < heavy_hitters_count) {
+            entry = &heavy_hitters->entries[heavy_hitters->used_count++];
+            entry->count = 0;
+            entry->error = 0;
+        } else {
+            /* Replace the least frequent one */
+            entry = &heavy_hitters->entries[0];
+            for (i = 1; i < heavy_hitters_count; ++i) {
+                if (heavy_hitters->entries[i].count < entry->count)
+                    entry = &heavy_hitters->entries[i];
+            }
+            entry->error = entry->count;
+        }
+        entry->fingerprint = fingerprint_counter->fingerprint;
+        entry->error_code = fingerprint_counter->error_code;
+        entry->message_type_index = fingerprint_counter->message_type_index;
+        memcpy(entry->sample, fingerprint_counter->sample, fingerprint_sample_len);
+    }
+    entry->count += fingerprint_counter->counter;
+    SpinLockRelease(&heavy_hitters->mutex);
+}
+
+static void
+heavy_hitters_reset(void)
+{
+    SpinLockAcquire(&heavy_hitters->mutex);
+    heavy_hitters->used_count = 0;
+    memset(heavy_hitters->dropped_count, 0, sizeof(heavy_hitters->dropped_count));
+    SpinLockRelease(&heavy_hitters->mutex);
+}
+
+/* Find index slot of the key or the empty slot where it goes */
+static uint32
+cumulative_counters_slot(const MessageInfo *key)
+{
+    uint32 mask = cumulative_slots * 2 - 1;
+    uint32 slot = message_info_hash(key) & mask;
+    while (cumulative_counters->index[slot] != 0 &&
+           memcmp(&cumulative_counters->entries[cumulative_counters->index[slot] - 1].key,
+                  key, sizeof(MessageInfo)) != 0)
+        slot = (slot + 1) & mask;
+    return slot;
+}
+
+/* Remove index slot moving back the keys after it, so their probe chains stay unbroken */
+static void
+cumulative_counters_unlink(uint32 slot)
+{
+    uint32 mask = cumulative_slots * 2 - 1;
+    uint32 next = (slot + 1) & mask;
+    uint32 home;
+    while (cumulative_counters->index[next] != 0) {
+        home = message_info_hash(&cumulative_counters->entries[cumulative_counters->index[next] - 1].key) & mask;
+        if (((next - home) & mask) >= ((next - slot) & mask)) {
+            cumulative_counters->index[slot] = cumulative_counters->index[next];
+            slot = next;
+        }
+        next = (next + 1) & mask;
+    }
+    cumulative_counters->index[slot] = 0;
+}
+
+/*
+ * Add counters of the closed interval. Only the worker writes, so it looks
+ * for keys and for the entry to evict without mutex.
+ */
+static void
+cumulative_counters_add_interval(IntervalCounters *counters)
+{
+    CounterEntry *entries = interval_counters_entries(counters);
+    uint32 entries_count = pg_atomic_read_u32(&counters->entries_count);
+    uint64 tick = cumulative_counters->tick + 1;
+    uint32 count;
+    uint32 slot;
+    uint32 i;
+    int j;
+    MessageInfo key;
+    CumulativeCounter *entry;
+    CumulativeCounter *victim;
+
+    for (i = 0; i < entries_count; ++i) {
+        count = pg_atomic_read_u32(&entries[i].counter);
+        if (count == 0)
+            continue;
+        message_key_unpack(&entries[i].key, &key);
+        slot = cumulative_counters_slot(&key);
+        if (cumulative_counters->index[slot] != 0) {
+            entry = &cumulative_counters->entries[cumulative_counters->index[slot] - 1];
+            SpinLockAcquire(&cumulative_counters->mutex);
+            entry->count += count;
+            entry->referenced = true;
+            SpinLockRelease(&cumulative_counters->mutex);
+            continue;
+        }
+        if (cumulative_counters->used_count < cumulative_slots) {
+            SpinLockAcquire(&cumulative_counters->mutex);
+            entry = &cumulative_counters->entries[cumulative_counters->used_count++];
+            entry->key = key;
+            entry->count = count;
+            entry->referenced = true;
+            cumulative_counters->index[slot] = cumulative_counters->used_count;
+            SpinLockRelease(&cumulative_counters->mutex);
+            continue;
+        }
+        /* Stops within two turns, the first one clears all flags */
+        for (;;) {
+            victim = &cumulative_counters->entries[cumulative_counters->clock_hand];
+            cumulative_counters->clock_hand = (cumulative_counters->clock_hand + 1) % cumulative_slots;
+            if (!victim->referenced)
+                break;
+            victim->referenced = false;
+        }
+        SpinLockAcquire(&cumulative_counters->mutex);
+        cumulative_counters->evicted_count[victim->key.message_type_index] += victim->count;
+        cumulative_counters_unlink(cumulative_counters_slot(&victim->key));
+        victim->key = key;
+        victim->count = count;
+        victim->referenced = true;
+        cumulative_counters->index[cumulative_counters_slot(&victim->key)] = victim - cumulative_counters->entries + 1;
+        SpinLockRelease(&cumulative_counters->mutex);
+    }
+    SpinLockAcquire(&cumulative_counters->mutex);
+    for (j = 0; j < message_types_count; ++j)
+        cumulative_counters->overflow_count[j] += pg_atomic_read_u32(&counters->overflow_count[j]);
+    cumulative_counters->tick = tick;
+    SpinLockRelease(&cumulative_counters->mutex);
+}
+
+static void
+cumulative_counters_reset(void)
+{
+    SpinLockAcquire(&cumulative_counters->mutex);
+    cumulative_counters->used_count = 0;
+    cumulative_counters->clock_hand = 0;
+    cumulative_counters->tick = 0;
+    memset(cumulative_counters->evicted_count, 0, sizeof(cumulative_counters->evicted_count));
+    memset(cumulative_counters->overflow_count, 0, sizeof(cumulative_counters->overflow_count));
+    memset(cumulative_counters->index, 0, sizeof(cumulative_counters->index));
+    SpinLockRelease(&cumulative_counters->mutex);
+}
+
+/* Forget all buckets, called with the rest of statistics reset */
+static void
+rollup_tiers_reset(void)
+{
+    RollupTier *tier;
+    int i;
+    int j;
+    for (i = 0; i < rollup_tiers_count; ++i) {
+        tier = get_rollup_tier(i);
+        pg_atomic_write_u64(&tier->current_bucket, 0);
+        for (j = 0; j < tier->buckets_count; ++j)
+            interval_counters_reset(get_tier_bucket(i, j));
+    }
+}
+
+/* Add the closed interval to the current bucket of every tier, see RollupTier */
+static void
+rollup_tiers_add_interval(IntervalCounters *counters)
+{
+    CounterEntry *entries = interval_counters_entries(counters);
+    uint32 entries_count = pg_atomic_read_u32(&counters->entries_count);
+    TimestampTz start_time = (TimestampTz) pg_atomic_read_u64(&counters->start_time);
+    TimestampTz end_time = (TimestampTz) pg_atomic_read_u64(&counters->end_time);
+    TimestampTz bucket_start;
+    RollupTier *tier;
+    IntervalCounters *bucket;
+    uint64 current_bucket;
+    uint32 count;
+    uint32 i;
+    int j;
+    int k;
+
+    for (j = 0; j < rollup_tiers_count; ++j) {
+        tier = get_rollup_tier(j);
+        if (tier->buckets_count == 0)
+            continue;
+        current_bucket = pg_atomic_read_u64(&tier->current_bucket);
+        bucket = get_tier_bucket(j, current_bucket % tier->buckets_count);
+        bucket_start = (TimestampTz) pg_atomic_read_u64(&bucket->start_time);
+        if (bucket_start != 0 && start_time / rollup_tier_periods[j] != bucket_start / rollup_tier_periods[j]) {
+            current_bucket++;
+            bucket = get_tier_bucket(j, current_bucket % tier->buckets_count);
+            bucket_start = 0;
+        }
+        interval_counters_begin_change(bucket);
+        if (bucket_start == 0) {
+            pg_atomic_write_u64(&bucket->end_time, 0);
+            interval_counters_clear(bucket);
+            pg_atomic_write_u64(&bucket->start_time, start_time);
+            pg_atomic_write_u64(&tier->current_bucket, current_bucket);
+        }
+        for (i = 0; i < entries_count; ++i) {
+            count = pg_atomic_read_u32(&entries[i].counter);
+            if (count > 0)
+                interval_counters_add(bucket, &entries[i].key, count, interval_counters_estimated(counters)[i]);
+        }
+        for (k = 0; k < message_types_count; ++k)
+            pg_atomic_fetch_add_u32(&bucket->overflow_count[k], pg_atomic_read_u32(&counters->overflow_count[k]));
+        pg_atomic_write_u64(&bucket->end_time, end_time);
+        interval_counters_end_change(bucket);
+    }
+}
+
+/* Start of the period which time falls into, times before 2000 are negative */
+static TimestampTz
+period_start(TimestampTz time, int64 period)
+{
+    return time - ((time % period) + period) % period;
+}
+
+/*
+ * Count of started buckets of the tier going back from the newest one. The
+ * current bucket is empty until the first interval after reset or backfill,
+ * then the newest one is before it.
+ */
+static int
+rollup_tier_started_count(int tier_index, uint64 *newest_bucket)
+{
+    RollupTier *tier = get_rollup_tier(tier_index);
+    uint64 newest;
+    int started;
+    if (tier->buckets_count == 0)
+        return 0;
+    /* Plus buckets_count, so going back doesn't wrap below zero */
+    newest = pg_atomic_read_u64(&tier->current_bucket) + tier->buckets_count;
+    if (pg_atomic_read_u64(&get_tier_bucket(tier_index, newest % tier->buckets_count)->start_time) == 0)
+        newest--;
+    for (started = 0; started < tier->buckets_count; ++started) {
+        if (pg_atomic_read_u64(&get_tier_bucket(tier_index, (newest - started) % tier->buckets_count)->start_time) == 0)
+            break;
+    }
+    *newest_bucket = newest;
+    return started;
+}
+
+static void
+backfill_queue_init(void)
+{
+    SpinLockInit(&backfill_queue->mutex);
+    backfill_queue->owner_pid = 0;
+    backfill_queue->backfill_id = 0;
+    backfill_queue->queued_count = 0;
+    backfill_queue->applied_count = 0;
+    backfill_queue->used_count = 0;
+}
+
+/* Place buckets of a new backfill before the oldest started bucket of every tier */
+static void
+backfill_start(void)
+{
+    RollupTier *tier;
+    BackfillCursor *cursor;
+    uint64 newest_bucket;
+    int started;
+    int j;
+    for (j = 0; j < rollup_tiers_count; ++j) {
+        tier = get_rollup_tier(j);
+        cursor = &backfill_cursors[j];
+        cursor->bucket = NULL;
+        cursor->full = (tier->buckets_count == 0);
+        if (cursor->full)
+            continue;
+        started = rollup_tier_started_count(j, &newest_bucket);
+        if (started == 0) {
+            /* The current bucket is filled by messages from now on */
+            newest_bucket = pg_atomic_read_u64(&tier->current_bucket) + tier->buckets_count - 1;
+            cursor->bucket_start = period_start(logerrors_now(), rollup_tier_periods[j]);
+        } else
+            cursor->bucket_start = period_start(
+                    (TimestampTz) pg_atomic_read_u64(&get_tier_bucket(
+                            j, (newest_bucket - started + 1) % tier->buckets_count)->start_time),
+                    rollup_tier_periods[j]);
+        cursor->next_bucket = (int) ((newest_bucket - started) % tier->buckets_count);
+    }
+}
+
+/*
+ * Add counter of a backfill to buckets of tiers. Counters come newest bucket
+ * first, older ones take the next free bucket back until there is none.
+ */
+static void
+backfill_apply_entry(const BackfillEntry *entry)
+{
+    RollupTier *tier;
+    BackfillCursor *cursor;
+    IntervalCounters *bucket;
+    TimestampTz bucket_start;
+    MessageKey key;
+    int64 period;
+    int j;
+    for (j = 0; j < rollup_tiers_count; ++j) {
+        tier = get_rollup_tier(j);
+        cursor = &backfill_cursors[j];
+        period = rollup_tier_periods[j];
+        if (tier->buckets_count == 0 || (entry->key.hourly && period < USECS_PER_HOUR))
+            continue;
+        bucket_start = period_start(entry->key.bucket_start, period);
+        /* Time with live statistics or a counter out of order */
+        if (bucket_start > cursor->bucket_start || (bucket_start == cursor->bucket_start && cursor->bucket == NULL))
+            continue;
+        if (bucket_start < cursor->bucket_start) {
+            if (cursor->full)
+                continue;
+            bucket = get_tier_bucket(j, cursor->next_bucket);
+            if (cursor->next_bucket == (int) (pg_atomic_read_u64(&tier->current_bucket) % tier->buckets_count) ||
+                pg_atomic_read_u64(&bucket->start_time) != 0) {
+                cursor->full = true;
+                continue;
+            }
+            interval_counters_begin_change(bucket);
+            interval_counters_clear(bucket);
+            pg_atomic_write_u64(&bucket->start_time, bucket_start);
+            pg_atomic_write_u64(&bucket->end_time, bucket_start + period);
+            interval_counters_end_change(bucket);
+            cursor->bucket = bucket;
+            cursor->bucket_start = bucket_start;
+            cursor->next_bucket = (cursor->next_bucket + tier->buckets_count - 1) % tier->buckets_count;
+        }
+        /* The ring went round and took the bucket for new messages */
+        if ((TimestampTz) pg_atomic_read_u64(&cursor->bucket->start_time) != cursor->bucket_start) {
+            cursor->full = true;
+            continue;
+        }
+        interval_counters_begin_change(cursor->bucket);
+        if (entry->key.overflow)
+            pg_atomic_fetch_add_u32(&cursor->bucket->overflow_count[entry->key.info.message_type_index], entry->count);
+        else {
+            message_key_pack(&entry->key.info, &key);
+            interval_counters_add(cursor->bucket, &key, entry->count, 0);
+        }
+        interval_counters_end_change(cursor->bucket);
+    }
+}
+
+/* Apply counters which a backfill passed since the last call */
+static void
+backfill_queue_drain(void)
+{
+    uint64 backfill_id;
+    int used_count;
+    int i;
+    SpinLockAcquire(&backfill_queue->mutex);
+    backfill_id = backfill_queue->backfill_id;
+    used_count = backfill_queue->used_count;
+    memcpy(backfill_batch, backfill_queue->entries, sizeof(BackfillEntry) * used_count);
+    backfill_queue->used_count = 0;
+    SpinLockRelease(&backfill_queue->mutex);
+    if (used_count == 0)
+        return;
+    if (backfill_id != backfill_applied_id) {
+        backfill_start();
+        backfill_applied_id = backfill_id;
+    }
+    for (i = 0; i < used_count; ++i)
+        backfill_apply_entry(&backfill_batch[i]);
+    SpinLockAcquire(&backfill_queue->mutex);
+    if (backfill_queue->backfill_id == backfill_id)
+        backfill_queue->applied_count += used_count;
+    SpinLockRelease(&backfill_queue->mutex);
+}
+
+static void
+alert_events_init(void)
+{
+    SpinLockInit(&alert_events->mutex);
+    alert_events->fired_count = 0;
+}
+
+/* Forget baselines and fired alerts, called with the rest of statistics reset */
+static void
+alerts_reset(void)
+{
+    alert_baselines_used = 0;
+    SpinLockAcquire(&alert_events->mutex);
+    alert_events->fired_count = 0;
+    SpinLockRelease(&alert_events->mutex);
+}
+
+/* Code of a name of errcodes.txt like ERRCODE_T_R_DEADLOCK_DETECTED, -1 if there is no such name */
+static int
+get_error_code_by_name(const char *name)
+{
+    int i;
+    for (i = 0; i < error_codes_count; ++i) {
+        if (pg_strcasecmp(&error_names[error_name_offsets[i]], name) == 0)
+            return error_codes[i];
+    }
+    return -1;
+}
+
+/* Parse a code of a rule: "*", SQLSTATE, "40***" or name of a code */
+static bool
+alert_rule_parse_code(char *code, AlertRule *rule)
+{
+    int i;
+    rule->any_code = false;
+    rule->whole_class = false;
+    if (strcmp(code, "*") == 0) {
+        rule->any_code = true;
+        return true;
+    }
+    if (strlen(code) == len_sqlstate_str) {
+        for (i = 0; i < len_sqlstate_str; ++i)
+            code[i] = pg_toupper((unsigned char) code[i]);
+        if (!sqlstate_is_valid(code, true))
+            return false;
+        if (strcmp(code + 2, "***") == 0) {
+            rule->error_code = MAKE_SQLSTATE(code[0], code[1], '0', '0', '0');
+            rule->whole_class = true;
+            return true;
+        }
+        rule->error_code = MAKE_SQLSTATE(code[0], code[1], code[2], code[3], code[4]);
+        return true;
+    }
+    rule->error_code = get_error_code_by_name(code);
+    return rule->error_code != -1;
+}
+
+/*
+ * Parse logerrors.alert_rules: rules like "40P01 > 10" (messages in an
+ * interval) or "* > 3 sigma" (standard deviations above baseline) separated
+ * by ','. Only the worker calls it.
+ */
+static void
+alert_rules_build(void)
+{
+    char *copy;
+    char *item;
+    char *end;
+    char *code;
+    AlertRule *rule;
+    alert_rules_count = 0;
+    if (alert_rules_str == NULL)
+        return;
+    copy = pstrdup(alert_rules_str);
+    for (item = strtok(copy, ","); item != NULL; item = strtok(NULL, ",")) {
+        while (*item == ' ' || *item == '\t')
+            item++;
+        end = item + strlen(item);
+        while (end > item && (end[-1] == ' ' || end[-1] == '\t'))
+            end--;
+        *end = '\0';
+        if (*item == '\0')
+            continue;
+        if (alert_rules_count == max_alert_rules) {
+            elog(WARNING, "logerrors: only first %d rules of logerrors.alert_rules are used", max_alert_rules);
+            break;
+        }
+        rule = &alert_rules[alert_rules_count];
+        strlcpy(rule->text, item, alert_rule_len);
+        code = item;
+        item = strchr(item, '>');
+        if (item == NULL) {
+            elog(WARNING, "logerrors: alert rule \"%s\" should look like \"40P01 > 10\" or \"* > 3 sigma\"", rule->text);
+            continue;
+        }
+        end = item;
+        while (end > code && (end[-1] == ' ' || end[-1] == '\t'))
+            end--;
+        *end = '\0';
+        rule->threshold = strtod(item + 1, &end);
+        if (end == item + 1 || rule->threshold < 0) {
+            elog(WARNING, "logerrors: alert rule \"%s\" should have a threshold which is not negative", rule->text);
+            continue;
+        }
+        while (*end == ' ' || *end == '\t')
+            end++;
+        rule->sigma = pg_strncasecmp(end, "sigma", 5) == 0;
+        if (rule->sigma)
+            end += 5;
+        else if (pg_strncasecmp(end, "/interval", 9) == 0)
+            end += 9;
+        if (*end != '\0') {
+            elog(WARNING, "logerrors: alert rule \"%s\" should end with a threshold or \"sigma\"", rule->text);
+            continue;
+        }
+        if (!alert_rule_parse_code(code, rule)) {
+            elog(WARNING, "logerrors: unknown errcode \"%s\" in alert rule \"%s\"", code, rule->text);
+            continue;
+        }
+        alert_rules_count++;
+    }
+    pfree(copy);
+}
+
+static bool
+alert_rule_matches(const AlertRule *rule, int error_code)
+{
+    if (rule->any_code)
+        return true;
+    if (error_code == alert_overflow_code)
+        return false;
+    return rule->whole_class ? rule->error_code == ERRCODE_TO_CATEGORY(error_code)
+                             : rule->error_code == error_code;
+}
+
+/*
+ * Baseline of the code and type. A new one replaces the quietest baseline
+ * when there is no free one, but not one counted in this interval already.
+ */
+static AlertBaseline *
+alert_baseline_lookup(int error_code, int message_type_index)
+{
+    AlertBaseline *baseline = NULL;
+    int i;
+    for (i = 0; i < alert_baselines_used; ++i) {
+        if (alert_baselines[i].error_code == error_code &&
+            alert_baselines[i].message_type_index == message_type_index)
+            return &alert_baselines[i];
+    }
+    if (alert_baselines_used < alert_baselines_count) {
+        baseline = &alert_baselines[alert_baselines_used++];
+    } else {
+        for (i = 0; i < alert_baselines_count; ++i) {
+            if (alert_counts[i] == 0 && (baseline == NULL || alert_baselines[i].mean < baseline->mean))
+                baseline = &alert_baselines[i];
+        }
+        if (baseline == NULL)
+            return NULL;
+    }
+    baseline->error_code = error_code;
+    baseline->message_type_index = message_type_index;
+    baseline->mean = 0;
+    baseline->variance = 0;
+    baseline->intervals = 0;
+    baseline->firing = false;
+    alert_counts[baseline - alert_baselines] = 0;
+    return baseline;
+}
+
+/* Log the alert in one line and keep it for pg_log_errors_alerts() */
+static void
+alert_fire(const AlertBaseline *baseline, const AlertRule *rule, uint64 count, double threshold,
+           TimestampTz fired_at)
+{
+    AlertEvent *event;
+    double stddev = sqrt(baseline->variance);
+    bool overflow = (baseline->error_code == alert_overflow_code);
+    elog(LOG, "logerrors: alert rule=\"%s\" type=%s sqlstate=%s message=%s count=" UINT64_FORMAT
+              " threshold=%.2f baseline=%.2f stddev=%.2f",
+         rule->text, message_type_names[baseline->message_type_index],
+         overflow ? "" : unpack_sql_state(baseline->error_code),
+         overflow ? "OVERFLOW" : get_error_name(baseline->error_code),
+         count, threshold, baseline->mean, stddev);
+    SpinLockAcquire(&alert_events->mutex);
+    event = &alert_events->events[alert_events->fired_count % alert_events_count];
+    event->fired_at = fired_at;
+    event->error_code = baseline->error_code;
+    event->message_type_index = baseline->message_type_index;
+    event->count = count;
+    event->threshold = threshold;
+    event->mean = baseline->mean;
+    event->stddev = stddev;
+    memcpy(event->rule, rule->text, alert_rule_len);
+    alert_events->fired_count++;
+    SpinLockRelease(&alert_events->mutex);
+}
+
+/*
+ * Check counts of the closed interval against the rules and move
+ * baselines. A rule fires once when a count goes above its threshold and
+ * again only after the count has fallen below thresholds of all rules.
+ * Rules in standard deviations skip baselines younger than
+ * alert_warmup_intervals, and deviation of at least one message is
+ * assumed, so a steady count doesn't fire on its first change. Messages
+ * which didn't get a slot have a baseline of their type, which only rules
+ * for any code match. Without rules baselines are not kept.
+ */
+static void
+alerts_add_interval(IntervalCounters *counters, TimestampTz end_time)
+{
+    CounterEntry *entries = interval_counters_entries(counters);
+    uint32 entries_count = pg_atomic_read_u32(&counters->entries_count);
+    double alpha = 2.0 / (alert_baseline_intervals + 1);
+    double threshold = 0;
+    double diff;
+    uint32 count;
+    uint32 i;
+    int j;
+    MessageInfo key;
+    AlertBaseline *baseline;
+    AlertRule *rule;
+
+    if (alert_rules_count == 0)
+        return;
+    for (j = 0; j < alert_baselines_used; ++j)
+        alert_counts[j] = 0;
+    for (i = 0; i < entries_count; ++i) {
+        count = pg_atomic_read_u32(&entries[i].counter);
+        if (count == 0)
+            continue;
+        message_key_unpack(&entries[i].key, &key);
+        baseline = alert_baseline_lookup(key.error_code, key.message_type_index);
+        if (baseline != NULL)
+            alert_counts[baseline - alert_baselines] += count;
+    }
+    for (j = 0; j < message_types_count; ++j) {
+        count = pg_atomic_read_u32(&counters->overflow_count[j]);
+        if (count == 0)
+            continue;
+        baseline = alert_baseline_lookup(alert_overflow_code, j);
+        if (baseline != NULL)
+            alert_counts[baseline - alert_baselines] += count;
+    }
+    for (i = 0; i < (uint32) alert_baselines_used; ++i) {
+        baseline = &alert_baselines[i];
+        rule = NULL;
+        for (j = 0; j < alert_rules_count; ++j) {
+            if (!alert_rule_matches(&alert_rules[j], baseline->error_code))
+                continue;
+            if (alert_rules[j].sigma) {
+                if (baseline->intervals < alert_warmup_intervals)
+                    continue;
+                threshold = baseline->mean + alert_rules[j].threshold * Max(sqrt(baseline->variance), 1.0);
+            } else {
+                threshold = alert_rules[j].threshold;
+            }
+            if (alert_counts[i] > threshold) {
+                rule = &alert_rules[j];
+                break;
+            }
+        }
+        if (rule != NULL && !baseline->firing)
+            alert_fire(baseline, rule, alert_counts[i], threshold, end_time);
+        baseline->firing = (rule != NULL);
+        /* The first interval of a baseline starts it, the next ones move it */
+        if (baseline->intervals == 0) {
+            baseline->mean = alert_counts[i];
+        } else {
+            diff = alert_counts[i] - baseline->mean;
+            baseline->mean += alpha * diff;
+            baseline->variance = (1 - alpha) * (baseline->variance + alpha * diff * diff);
+        }
+        baseline->intervals++;
+    }
+}
+
+/* Move messages counted by backends to the interval */
+static void
+drain_backend_counters(IntervalCounters *interval_counters)
+{
+    int i;
+    int j;
+    BackendCounters *counters;
+    FingerprintCounter fingerprints[backend_fingerprint_slots];
+    uint32 fingerprints_dropped[message_types_count];
+    int fingerprints_used;
+    uint32 class_count[message_types_count][error_class_slots];
+    uint64 drained_class_count[message_types_count][error_class_slots];
+    MessageKey key;
+    uint64 applied_reset_epoch;
+    int k;
+    applied_reset_epoch = pg_atomic_read_u64(&global_variables->applied_reset_epoch);
+    memset(drained_class_count, 0, sizeof(drained_class_count));
+    for (i = 0; i <= global_variables->backends_count; ++i) {
+        counters = get_backend_counters(i);
+        SpinLockAcquire(&counters->mutex);
+        if (counters->epoch < applied_reset_epoch) {
+            /* Counted before reset and not drained since */
+            backend_counters_clear(counters);
+            counters->epoch = applied_reset_epoch;
+        } else if (counters->epoch > applied_reset_epoch) {
+            /* Counted after reset the worker didn't apply yet, keep for the next tick */
+            SpinLockRelease(&counters->mutex);
+            continue;
+        }
+        if (counters->used_count > 0) {
+            for (j = 0; j < counters->used_count; ++j) {
+                message_key_pack(&counters->counters[j].key, &key);
+                interval_counters_add(interval_counters, &key, counters->counters[j].counter,
+                                      counters->counters[j].estimated ? 1 : 0);
+            }
+            counters->used_count = 0;
+            memset(counters->index, 0, sizeof(counters->index));
+        }
+        for (j = 0; j < message_types_count; ++j) {
+            if (counters->overflow_count[j] == 0)
+                continue;
+            pg_atomic_fetch_add_u32(&interval_counters->overflow_count[j], counters->overflow_count[j]);
+            counters->overflow_count[j] = 0;
+        }
+        /* Fingerprints are merged out of mutex, the backend may go on meanwhile */
+        fingerprints_used = counters->fingerprints_used;
+        memcpy(fingerprints, counters->fingerprints, sizeof(FingerprintCounter) * fingerprints_used);
+        memcpy(fingerprints_dropped, counters->fingerprints_dropped, sizeof(fingerprints_dropped));
+        counters->fingerprints_used = 0;
+        memset(counters->fingerprints_dropped, 0, sizeof(counters->fingerprints_dropped));
+        memcpy(class_count, counters->class_count, sizeof(class_count));
+        memset(counters->class_count, 0, sizeof(counters->class_count));
+        SpinLockRelease(&counters->mutex);
+
+        for (j = 0; j < message_types_count; ++j) {
+            for (k = 0; k < error_class_slots; ++k)
+                drained_class_count[j][k] += class_count[j][k];
+        }
+
+        for (j = 0; j < fingerprints_used; ++j)
+            heavy_hitters_add(&fingerprints[j]);
+        SpinLockAcquire(&heavy_hitters->mutex);
+        for (j = 0; j < message_types_count; ++j)
+            heavy_hitters->dropped_count[j] += fingerprints_dropped[j];
+        SpinLockRelease(&heavy_hitters->mutex);
+    }
+
+    /* Classes go to totals at once and to the interval on the tick */
+    SpinLockAcquire(&class_counters->mutex);
+    for (j = 0; j < message_types_count; ++j) {
+        for (k = 0; k < error_class_slots; ++k)
+            class_counters->total_count[j][k] += drained_class_count[j][k];
+    }
+    SpinLockRelease(&class_counters->mutex);
+    for (j = 0; j < message_types_count; ++j) {
+        for (k = 0; k < error_class_slots; ++k)
+            class_tick_count[j][k] += drained_class_count[j][k];
+    }
+}
+
+static void
+backend_counters_init(void)
+{
+    int i;
+    int j;
+    BackendCounters *counters;
+    memset(backends_buffer, 0, (global_variables->backends_count + 1) * backend_counters_size);
+    for (i = 0; i <= global_variables->backends_count; ++i) {
+        counters = get_backend_counters(i);
+        SpinLockInit(&counters->mutex);
+        pg_atomic_init_u64(&counters->totals_epoch, 0);
+        for (j = 0; j < message_types_count; ++j)
+            pg_atomic_init_u64(&counters->total_count[j], 0);
+        pg_atomic_init_u64(&counters->hook_calls, 0);
+        pg_atomic_init_u64(&counters->filtered_count, 0);
+        pg_atomic_init_u64(&counters->sampled_out_count, 0);
+        pg_atomic_init_u64(&counters->timed_calls, 0);
+        pg_atomic_init_u64(&counters->hook_time_ns, 0);
+        pg_atomic_init_u64(&counters->hook_time_max_ns, 0);
+    }
+}
+
+/* Sum of totals of backends which counted since the last reset */
+static uint64
+get_total_count(int message_type_index)
+{
+    int i;
+    uint64 result = 0;
+    uint64 reset_epoch;
+    BackendCounters *counters;
+    reset_epoch = pg_atomic_read_u64(&global_variables->reset_epoch);
+    for (i = 0; i <= global_variables->backends_count; ++i) {
+        counters = get_backend_counters(i);
+        if (pg_atomic_read_u64(&counters->totals_epoch) != reset_epoch)
+            continue;
+        pg_read_barrier();
+        result += pg_atomic_read_u64(&counters->total_count[message_type_index]);
+    }
+    return result;
+}
+
+/* Counts of every class and type since reset, summed like get_total_count() */
+static void
+get_class_counts(uint64 counts[message_types_count][error_class_slots])
+{
+    SpinLockAcquire(&class_counters->mutex);
+    memcpy(counts, class_counters->total_count, sizeof(class_counters->total_count));
+    SpinLockRelease(&class_counters->mutex);
+}
+
+static void
+error_classes_build(void)
+{
+    int i;
+    memset(error_class_index, error_classes_count, sizeof(error_class_index));
+    for (i = 0; i < error_classes_count; ++i)
+        error_class_index[error_classes[i]] = i;
+}
+
+static void
+class_counters_init(void)
+{
+    SpinLockInit(&class_counters->mutex);
+    memset(class_counters->interval_count, 0, sizeof(class_counters->interval_count));
+    memset(class_counters->window_count, 0, sizeof(class_counters->window_count));
+    memset(class_counters->total_count, 0, sizeof(class_counters->total_count));
+}
+
+/*
+ * Count intervals of classes from now on, the worker calls it on start and
+ * on reset, when totals start from zero too.
+ */
+static void
+class_counters_start(bool reset)
+{
+    memset(class_tick_count, 0, sizeof(class_tick_count));
+    class_ticks = 0;
+    SpinLockAcquire(&class_counters->mutex);
+    memset(class_counters->interval_count, 0, sizeof(class_counters->interval_count));
+    memset(class_counters->window_count, 0, sizeof(class_counters->window_count));
+    if (reset)
+        memset(class_counters->total_count, 0, sizeof(class_counters->total_count));
+    SpinLockRelease(&class_counters->mutex);
+}
+
+/*
+ * Close the interval of classes: what was drained from backends since the
+ * last tick goes to the ring, sums of the last intervals_count of the ring
+ * to the window.
+ */
+static void
+class_counters_add_interval(void)
+{
+    uint64 window_count[message_types_count][error_class_slots];
+    uint32 (*interval_count)[error_class_slots];
+    uint64 intervals;
+    uint64 i;
+    int j;
+    int k;
+
+    interval_count = class_ring[class_ticks % max_intervals_count];
+    for (j = 0; j < message_types_count; ++j) {
+        for (k = 0; k < error_class_slots; ++k)
+            interval_count[j][k] = (uint32) class_tick_count[j][k];
+    }
+    memset(class_tick_count, 0, sizeof(class_tick_count));
+    class_ticks++;
+    intervals = Min(class_ticks, (uint64) global_variables->intervals_count);
+    memset(window_count, 0, sizeof(window_count));
+    for (i = 0; i < intervals; ++i) {
+        for (j = 0; j < message_types_count; ++j) {
+            for (k = 0; k < error_class_slots; ++k)
+                window_count[j][k] += class_ring[(class_ticks - 1 - i) % max_intervals_count][j][k];
+        }
+    }
+    SpinLockAcquire(&class_counters->mutex);
+    for (j = 0; j < message_types_count; ++j) {
+        for (k = 0; k < error_class_slots; ++k)
+            class_counters->interval_count[j][k] = interval_count[j][k];
+    }
+    memcpy(class_counters->window_count, window_count, sizeof(window_count));
+    SpinLockRelease(&class_counters->mutex);
+}
+
+static char*
+get_user_by_oid(Oid user_oid)
+{
+    HeapTuple role_tuple;
+    char* result;
+    role_tuple = SearchSysCache1(AUTHOID, ObjectIdGetDatum(user_oid));
+    if (HeapTupleIsValid(role_tuple))
+    {
+        result = pstrdup(NameStr(((Form_pg_authid) GETSTRUCT(role_tuple))->rolname));
+        ReleaseSysCache(role_tuple);
+    }
+    else
+        result = NULL;
+    return result;
+}
+
+
+static void
+logerrors_init(void)
+{
+    int i;
+    pg_atomic_init_u64(&global_variables->messagesBuffer.current_interval_index, 0);
+    heavy_hitters_reset();
+    cumulative_counters_reset();
+    rollup_tiers_reset();
+    for (i = 0; i < ring_intervals_count; ++i) {
+        interval_counters_init(get_interval_counters(i), global_variables->interval_slots);
+    }
+    interval_counters_init(window_counters, global_variables->window_slots);
+    pg_atomic_write_u64(&get_interval_counters(0)->start_time, logerrors_now());
+    slow_log_info_init();
+}
+
+/* Reset was requested and the worker didn't apply it yet */
+static bool
+stats_reset_pending(void)
+{
+    return pg_atomic_read_u64(&global_variables->applied_reset_epoch) !=
+           pg_atomic_read_u64(&global_variables->reset_epoch);
+}
+
+/*
+ * Forget counted messages after pg_log_errors_reset(). Only the worker
+ * calls it, as the only writer of intervals, so readers retry copies
+ * overlapping it instead of seeing half-cleared intervals.
+ */
+static void
+stats_apply_reset(void)
+{
+    uint64 reset_epoch;
+    int i;
+    reset_epoch = pg_atomic_read_u64(&global_variables->reset_epoch);
+    slow_log_info_init();
+    heavy_hitters_reset();
+    cumulative_counters_reset();
+    rollup_tiers_reset();
+    alerts_reset();
+    class_counters_start(true);
+    /* A backfill in progress places its next buckets anew */
+    backfill_applied_id = 0;
+    for (i = 0; i < ring_intervals_count; ++i)
+        interval_counters_reset(get_interval_counters(i));
+    interval_counters_reset(window_counters);
+    pg_atomic_write_u64(&global_variables->messagesBuffer.current_interval_index, 0);
+    pg_atomic_write_u64(&get_interval_counters(0)->start_time, logerrors_now());
+    pg_write_barrier();
+    pg_atomic_write_u64(&global_variables->applied_reset_epoch, reset_epoch);
+}
+
+static void
+logerrors_update_info(void)
+{
+    int current_interval;
+    int expired_interval;
+    IntervalCounters *next_counters;
+    TimestampTz now;
+    uint64 sequence;
+    if (global_variables == NULL) {
+        return;
+    }
+    intervals_ring_free_old();
+    if (stats_reset_pending())
+        stats_apply_reset();
+    now = logerrors_now();
+    current_interval = pg_atomic_read_u64(&global_variables->messagesBuffer.current_interval_index) %
+            (uint64)ring_intervals_count;
+    drain_backend_counters(get_interval_counters(current_interval));
+    cumulative_counters_add_interval(get_interval_counters(current_interval));
+    alerts_add_interval(get_interval_counters(current_interval), now);
+    class_counters_add_interval();
+    /* Move the window: add closed interval and subtract the one which leaves it */
+    expired_interval = (current_interval - global_variables->intervals_count + ring_intervals_count)
+            % ring_intervals_count;
+    interval_counters_begin_change(window_counters);
+    window_apply_interval(get_interval_counters(current_interval), false);
+    window_apply_interval(get_interval_counters(expired_interval), true);
+    interval_counters_end_change(window_counters);
+    if (window_needs_rebuild())
+        window_rebuild(current_interval);
+    sequence = pg_atomic_read_u64(&global_variables->messagesBuffer.last_sequence) + 1;
+    pg_atomic_write_u64(&get_interval_counters(current_interval)->sequence, sequence);
+    pg_write_barrier();
+    pg_atomic_write_u64(&get_interval_counters(current_interval)->end_time, now);
+    pg_atomic_write_u64(&global_variables->messagesBuffer.last_sequence, sequence);
+    rollup_tiers_add_interval(get_interval_counters(current_interval));
+    current_interval = (current_interval + 1) % ring_intervals_count;
+    next_counters = get_interval_counters(current_interval);
+    /* Readers of history drop the oldest interval once its end is gone */
+    interval_counters_begin_change(next_counters);
+    pg_atomic_write_u64(&next_counters->end_time, 0);
+    pg_atomic_write_u64(&next_counters->sequence, 0);
+    interval_counters_clear(next_counters);
+    pg_atomic_write_u64(&next_counters->start_time, now);
+    interval_counters_end_change(next_counters);
+    // no locking is required as this is the only place where the current_interval_index changes
+    pg_atomic_write_u64(&global_variables->messagesBuffer.current_interval_index, current_interval);
+}
+
+static bool
+dump_write(FILE *file, const void *data, size_t size, pg_crc32c *crc)
+{
+    COMP_CRC32C(*crc, data, size);
+    return fwrite(data, size, 1, file) == 1;
+}
+
+static bool
+dump_read(FILE *file, void *data, size_t size, pg_crc32c *crc)
+{
+    if (fread(data, size, 1, file) != 1)
+        return false;
+    COMP_CRC32C(*crc, data, size);
+    return true;
+}
+
+static bool
+dump_interval(FILE *file, IntervalCounters *counters, pg_crc32c *crc)
+{
+    CounterEntry *entries = interval_counters_entries(counters);
+    MessageCount dump_entry;
+    uint64 times[3];
+    uint32 overflow_count[message_types_count];
+    uint32 entries_count;
+    uint32 i;
+    times[0] = pg_atomic_read_u64(&counters->start_time);
+    times[1] = pg_atomic_read_u64(&counters->end_time);
+    times[2] = pg_atomic_read_u64(&counters->sequence);
+    entries_count = pg_atomic_read_u32(&counters->entries_count);
+    for (i = 0; i < message_types_count; ++i)
+        overflow_count[i] = pg_atomic_read_u32(&counters->overflow_count[i]);
+    if (!dump_write(file, times, sizeof(times), crc) ||
+        !dump_write(file, &entries_count, sizeof(entries_count), crc) ||
+        !dump_write(file, overflow_count, sizeof(overflow_count), crc))
+        return false;
+    /* Padding goes to the file too */
+    memset(&dump_entry, 0, sizeof(dump_entry));
+    for (i = 0; i < entries_count; ++i) {
+        message_key_unpack(&entries[i].key, &dump_entry.key);
+        dump_entry.count = pg_atomic_read_u32(&entries[i].counter);
+        dump_entry.estimated = interval_counters_estimated(counters)[i];
+        if (!dump_write(file, &dump_entry, sizeof(dump_entry), crc))
+            return false;
+    }
+    return true;
+}
+
+/*
+ * Write statistics to logerrors_dump_file: header, slow log count, totals,
+ * sequence of the last closed interval, totals of classes, intervals of
+ * the window and the current one with their start and end times and sequences, slow log
+ * histograms, heavy hitters, cumulative counters, buckets of rollup tiers
+ * and CRC-32C of all that.
+ * The window is counted up again on load. Only the worker saves, as the
+ * only writer of intervals.
+ */
+static void
+logerrors_save(void)
+{
+    FILE *file;
+    pg_crc32c crc;
+    uint32 header[2] = {logerrors_dump_magic, logerrors_dump_version};
+    uint32 slow_count;
+    uint64 reset_time;
+    uint64 total_count[message_types_count];
+    uint64 class_count[message_types_count][error_class_slots];
+    int32 class_code;
+    int32 saved_classes = error_class_slots;
+    uint64 last_sequence;
+    int32 saved_intervals;
+    int current_interval;
+    uint32 used_count;
+    uint32 i;
+    SlowLogHistogram *histogram;
+    uint32 buckets[slow_log_buckets_count];
+    HeavyHitters *hitters_copy = palloc(sizeof(HeavyHitters));
+    CumulativeCounters *cumulative_copy = palloc(sizeof(CumulativeCounters));
+    RollupTier *tier;
+    uint64 newest_bucket;
+    int32 saved_buckets;
+    int j;
+
+    if (stats_reset_pending())
+        stats_apply_reset();
+    current_interval = pg_atomic_read_u64(&global_variables->messagesBuffer.current_interval_index) %
+            (uint64)ring_intervals_count;
+    /* Messages which are not drained yet belong to the current interval */
+    drain_backend_counters(get_interval_counters(current_interval));
+
+    file = AllocateFile(logerrors_dump_file ".tmp", PG_BINARY_W);
+    if (file == NULL)
+        goto error;
+    INIT_CRC32C(crc);
+    slow_count = pg_atomic_read_u32(&global_variables->slow_log_info.count);
+    reset_time = pg_atomic_read_u64(&global_variables->slow_log_info.reset_time);
+    for (j = 0; j < message_types_count; ++j)
+        total_count[j] = get_total_count(j);
+    last_sequence = pg_atomic_read_u64(&global_variables->messagesBuffer.last_sequence);
+    if (!dump_write(file, header, sizeof(header), &crc) ||
+        !dump_write(file, &slow_count, sizeof(slow_count), &crc) ||
+        !dump_write(file, &reset_time, sizeof(reset_time), &crc) ||
+        !dump_write(file, total_count, sizeof(total_count), &crc) ||
+        !dump_write(file, &last_sequence, sizeof(last_sequence), &crc))
+        goto error;
+
+    /* Totals of classes by their codes, classes of another build may differ; -1 is the rest */
+    get_class_counts(class_count);
+    if (!dump_write(file, &saved_classes, sizeof(saved_classes), &crc))
+        goto error;
+    for (i = 0; i < (uint32) saved_classes; ++i) {
+        class_code = i < error_classes_count ? error_classes[i] : -1;
+        if (!dump_write(file, &class_code, sizeof(class_code), &crc))
+            goto error;
+        for (j = 0; j < message_types_count; ++j) {
+            if (!dump_write(file, &class_count[j][i], sizeof(uint64), &crc))
+                goto error;
+        }
+    }
+
+    /* Sources go before intervals which refer to them */
+    used_count = pg_atomic_read_u32(&sources->used_count);
+    pg_read_barrier();
+    if (!dump_write(file, &used_count, sizeof(used_count), &crc) ||
+        !dump_write(file, sources->entries, sizeof(Source) * used_count, &crc))
+        goto error;
+
+    /* Oldest interval first, the current one last */
+    saved_intervals = global_variables->intervals_count + 1;
+    if (!dump_write(file, &saved_intervals, sizeof(saved_intervals), &crc))
+        goto error;
+    for (j = saved_intervals - 1; j >= 0; --j) {
+        if (!dump_interval(file, get_interval_counters((current_interval - j + ring_intervals_count)
+                                                       % ring_intervals_count), &crc))
+            goto error;
+    }
+
+    /* Histogram of the rest has no database and user and goes last */
+    used_count = pg_atomic_read_u32(&slow_log_histograms->used_count) + 1;
+    pg_read_barrier();
+    if (!dump_write(file, &used_count, sizeof(used_count), &crc))
+        goto error;
+    for (i = 0; i < used_count; ++i) {
+        histogram = &slow_log_histograms->histograms[i == used_count - 1 ? slow_log_histograms_count : i];
+        for (j = 0; j < slow_log_buckets_count; ++j)
+            buckets[j] = pg_atomic_read_u32(&histogram->buckets[j]);
+        if (!dump_write(file, &histogram->db_oid, sizeof(Oid), &crc) ||
+            !dump_write(file, &histogram->user_oid, sizeof(Oid), &crc) ||
+            !dump_write(file, buckets, sizeof(buckets), &crc))
+            goto error;
+    }
+
+    /* Copy of the summary, not to write the file under mutex */
+    SpinLockAcquire(&heavy_hitters->mutex);
+    memcpy(hitters_copy, heavy_hitters, sizeof(HeavyHitters));
+    SpinLockRelease(&heavy_hitters->mutex);
+    if (!dump_write(file, &hitters_copy->used_count, sizeof(int), &crc) ||
+        !dump_write(file, hitters_copy->dropped_count, sizeof(hitters_copy->dropped_count), &crc) ||
+        (hitters_copy->used_count > 0 &&
+         !dump_write(file, hitters_copy->entries, sizeof(HeavyHitter) * hitters_copy->used_count, &crc)))
+        goto error;
+
+    SpinLockAcquire(&cumulative_counters->mutex);
+    memcpy(cumulative_copy, cumulative_counters, sizeof(CumulativeCounters));
+    SpinLockRelease(&cumulative_counters->mutex);
+    if (!dump_write(file, &cumulative_copy->used_count, sizeof(int), &crc) ||
+        !dump_write(file, &cumulative_copy->tick, sizeof(uint64), &crc) ||
+        !dump_write(file, cumulative_copy->evicted_count, sizeof(cumulative_copy->evicted_count), &crc) ||
+        !dump_write(file, cumulative_copy->overflow_count, sizeof(cumulative_copy->overflow_count), &crc) ||
+        (cumulative_copy->used_count > 0 &&
+         !dump_write(file, cumulative_copy->entries, sizeof(CumulativeCounter) * cumulative_copy->used_count, &crc)))
+        goto error;
+
+    /* Buckets of every tier which were started, oldest first */
+    for (j = 0; j < rollup_tiers_count; ++j) {
+        tier = get_rollup_tier(j);
+        saved_buckets = (int32) rollup_tier_started_count(j, &newest_bucket);
+        if (!dump_write(file, &saved_buckets, sizeof(saved_buckets), &crc))
+            goto error;
+        for (i = saved_buckets; i > 0; --i) {
+            if (!dump_interval(file, get_tier_bucket(j, (newest_bucket - (i - 1)) % tier->buckets_count), &crc))
+                goto error;
+        }
+    }
+
+    FIN_CRC32C(crc);
+    if (fwrite(&crc, sizeof(crc), 1, file) != 1)
+        goto error;
+    if (FreeFile(file)) {
+        file = NULL;
+        goto error;
+    }
+    /* Rename of the whole file, so a crash while saving keeps the previous one */
+    (void) durable_rename(logerrors_dump_file ".tmp", logerrors_dump_file, LOG);
+    pfree(hitters_copy);
+    pfree(cumulative_copy);
+    return;
+
+error:
+    ereport(LOG,
+            (errcode_for_file_access(),
+                    errmsg("could not write file \"%s\": %m", logerrors_dump_file ".tmp")));
+    if (file)
+        FreeFile(file);
+    unlink(logerrors_dump_file ".tmp");
+    pfree(hitters_copy);
+    pfree(cumulative_copy);
+}
+
+/* Does a loaded message refer to a loaded source */
+static inline bool
+source_is_valid(uint32 source)
+{
+    return source < pg_atomic_read_u32(&sources->used_count) || source == sources_count;
+}
+
+static bool
+load_interval(FILE *file, IntervalCounters *counters, pg_crc32c *crc)
+{
+    MessageCount dump_entry;
+    MessageKey key;
+    uint64 times[3];
+    uint32 overflow_count[message_types_count];
+    uint32 entries_count;
+    uint32 i;
+    if (!dump_read(file, times, sizeof(times), crc) ||
+        !dump_read(file, &entries_count, sizeof(entries_count), crc) ||
+        !dump_read(file, overflow_count, sizeof(overflow_count), crc) ||
+        entries_count > max_interval_slots)
+        return false;
+    for (i = 0; i < entries_count; ++i) {
+        if (!dump_read(file, &dump_entry, sizeof(dump_entry), crc) ||
+            dump_entry.key.message_type_index < 0 || dump_entry.key.message_type_index >= message_types_count ||
+            (dump_entry.key.error_code & ~0x3FFFFFFF) != 0 || !source_is_valid(dump_entry.key.source))
+            return false;
+        /* Intervals which don't fit into intervals_count are read only to check them */
+        if (counters != NULL && dump_entry.count > 0) {
+            message_key_pack(&dump_entry.key, &key);
+            interval_counters_add(counters, &key, dump_entry.count, dump_entry.estimated);
+        }
+    }
+    if (counters == NULL)
+        return true;
+    for (i = 0; i < message_types_count; ++i)
+        pg_atomic_fetch_add_u32(&counters->overflow_count[i], overflow_count[i]);
+    pg_atomic_write_u64(&counters->start_time, times[0]);
+    pg_atomic_write_u64(&counters->end_time, times[1]);
+    pg_atomic_write_u64(&counters->sequence, times[2]);
+    return true;
+}
+
+/*
+ * Read statistics saved by logerrors_save() straight into just initialized
+ * shared memory. Saved intervals become the last ones of the buffer, so
+ * intervals_count and interval_slots may differ from the saved ones. On
+ * any error statistics are initialized again. The file is removed, so a
+ * crash restart doesn't load it once more.
+ */
+static void
+logerrors_load(void)
+{
+    FILE *file;
+    pg_crc32c crc;
+    pg_crc32c saved_crc;
+    uint32 header[2];
+    uint32 slow_count;
+    uint64 reset_time;
+    uint64 total_count[message_types_count];
+    uint64 class_total;
+    int32 class_code;
+    int32 saved_classes;
+    int class_slot;
+    uint64 last_sequence;
+    int32 saved_intervals;
+    int loaded_intervals;
+    uint32 histograms_count;
+    uint32 sources_used_count;
+    uint32 i;
+    Oid db_oid;
+    Oid user_oid;
+    uint32 buckets[slow_log_buckets_count];
+    SlowLogHistogram *histogram;
+    BackendCounters *shared_counters;
+    uint32 slot;
+    RollupTier *tier;
+    int32 saved_buckets;
+    int loaded_buckets;
+    int j;
+
+    file = AllocateFile(logerrors_dump_file, PG_BINARY_R);
+    if (file == NULL) {
+        if (errno != ENOENT)
+            ereport(LOG,
+                    (errcode_for_file_access(),
+                            errmsg("could not read file \"%s\": %m", logerrors_dump_file)));
+        return;
+    }
+    INIT_CRC32C(crc);
+    if (!dump_read(file, header, sizeof(header), &crc) ||
+        header[0] != logerrors_dump_magic || header[1] != logerrors_dump_version)
+        goto error;
+    if (!dump_read(file, &slow_count, sizeof(slow_count), &crc) ||
+        !dump_read(file, &reset_time, sizeof(reset_time), &crc) ||
+        !dump_read(file, total_count, sizeof(total_count), &crc) ||
+        !dump_read(file, &last_sequence, sizeof(last_sequence), &crc))
+        goto error;
+    pg_atomic_write_u64(&global_variables->messagesBuffer.last_sequence, last_sequence);
+    pg_atomic_write_u32(&global_variables->slow_log_info.count, slow_count);
+    if (!dump_read(file, &sources_used_count, sizeof(sources_used_count), &crc) ||
+        sources_used_count < 1 || sources_used_count > sources_count ||
+        !dump_read(file, sources->entries, sizeof(Source) * sources_used_count, &crc))
+        goto error;
+    for (i = 0; i < sources_used_count; ++i) {
+        sources->entries[i].application_name[NAMEDATALEN - 1] = '\0';
+        sources->entries[i].client_addr[source_client_addr_len - 1] = '\0';
+    }
+    pg_atomic_write_u32(&sources->used_count, sources_used_count);
+    pg_atomic_write_u64(&global_variables->slow_log_info.reset_time, reset_time);
+    /* Nobody has written anything yet, totals go to the shared backend counters */
+    shared_counters = get_backend_counters(global_variables->backends_count);
+    for (j = 0; j < message_types_count; ++j)
+        pg_atomic_write_u64(&shared_counters->total_count[j], total_count[j]);
+    if (!dump_read(file, &saved_classes, sizeof(saved_classes), &crc) ||
+        saved_classes < 0 || saved_classes > errcode_classes_count + 1)
+        goto error;
+    for (i = 0; i < (uint32) saved_classes; ++i) {
+        if (!dump_read(file, &class_code, sizeof(class_code), &crc))
+            goto error;
+        class_slot = class_code < 0 || class_code >= errcode_classes_count ? error_classes_count
+                                                                           : error_class_index[class_code];
+        for (j = 0; j < message_types_count; ++j) {
+            if (!dump_read(file, &class_total, sizeof(class_total), &crc))
+                goto error;
+            class_counters->total_count[j][class_slot] += class_total;
+        }
+    }
+
+    if (!dump_read(file, &saved_intervals, sizeof(saved_intervals), &crc) ||
+        saved_intervals < 1 || saved_intervals > max_actual_intervals_count)
+        goto error;
+    loaded_intervals = Min(saved_intervals, global_variables->intervals_count + 1);
+    for (j = 0; j < saved_intervals; ++j) {
+        if (!load_interval(file, j < saved_intervals - loaded_intervals ? NULL
+                                 : get_interval_counters(j - (saved_intervals - loaded_intervals)), &crc))
+            goto error;
+    }
+    pg_atomic_write_u64(&global_variables->messagesBuffer.current_interval_index, loaded_intervals - 1);
+    window_rebuild(loaded_intervals - 2);
+
+    if (!dump_read(file, &histograms_count, sizeof(histograms_count), &crc) ||
+        histograms_count > slow_log_histograms_count + 1)
+        goto error;
+    for (i = 0; i < histograms_count; ++i) {
+        if (!dump_read(file, &db_oid, sizeof(Oid), &crc) ||
+            !dump_read(file, &user_oid, sizeof(Oid), &crc) ||
+            !dump_read(file, buckets, sizeof(buckets), &crc))
+            goto error;
+        if (OidIsValid(db_oid) && pg_atomic_read_u32(&slow_log_histograms->used_count) < slow_log_histograms_count) {
+            histogram = &slow_log_histograms->histograms[pg_atomic_read_u32(&slow_log_histograms->used_count)];
+            histogram->db_oid = db_oid;
+            histogram->user_oid = user_oid;
+            pg_atomic_fetch_add_u32(&slow_log_histograms->used_count, 1);
+        } else
+            histogram = &slow_log_histograms->histograms[slow_log_histograms_count];
+        for (j = 0; j < slow_log_buckets_count; ++j)
+            pg_atomic_fetch_add_u32(&histogram->buckets[j], buckets[j]);
+    }
+
+    if (!dump_read(file, &heavy_hitters->used_count, sizeof(int), &crc) ||
+        heavy_hitters->used_count < 0 || heavy_hitters->used_count > heavy_hitters_count ||
+        !dump_read(file, heavy_hitters->dropped_count, sizeof(heavy_hitters->dropped_count), &crc) ||
+        (heavy_hitters->used_count > 0 &&
+         !dump_read(file, heavy_hitters->entries, sizeof(HeavyHitter) * heavy_hitters->used_count, &crc)))
+        goto error;
+    for (j = 0; j < heavy_hitters->used_count; ++j) {
+        if (heavy_hitters->entries[j].message_type_index < 0 ||
+            heavy_hitters->entries[j].message_type_index >= message_types_count)
+            goto error;
+        heavy_hitters->entries[j].sample[fingerprint_sample_len - 1] = '\0';
+    }
+
+    if (!dump_read(file, &cumulative_counters->used_count, sizeof(int), &crc) ||
+        cumulative_counters->used_count < 0 || cumulative_counters->used_count > cumulative_slots ||
+        !dump_read(file, &cumulative_counters->tick, sizeof(uint64), &crc) ||
+        !dump_read(file, cumulative_counters->evicted_count, sizeof(cumulative_counters->evicted_count), &crc) ||
+        !dump_read(file, cumulative_counters->overflow_count, sizeof(cumulative_counters->overflow_count), &crc) ||
+        (cumulative_counters->used_count > 0 &&
+         !dump_read(file, cumulative_counters->entries,
+                    sizeof(CumulativeCounter) * cumulative_counters->used_count, &crc)))
+        goto error;
+    for (j = 0; j < cumulative_counters->used_count; ++j) {
+        slot = cumulative_counters_slot(&cumulative_counters->entries[j].key);
+        if (cumulative_counters->entries[j].key.message_type_index < 0 ||
+            cumulative_counters->entries[j].key.message_type_index >= message_types_count ||
+            !source_is_valid(cumulative_counters->entries[j].key.source) ||
+            cumulative_counters->index[slot] != 0)
+            goto error;
+        cumulative_counters->index[slot] = j + 1;
+    }
+
+    /* Tiers may have less buckets now, the oldest ones are dropped then */
+    for (j = 0; j < rollup_tiers_count; ++j) {
+        tier = get_rollup_tier(j);
+        if (!dump_read(file, &saved_buckets, sizeof(saved_buckets), &crc) ||
+            saved_buckets < 0 || saved_buckets > max_tier_buckets)
+            goto error;
+        loaded_buckets = Min(saved_buckets, tier->buckets_count);
+        for (i = 0; i < (uint32) saved_buckets; ++i) {
+            if (!load_interval(file, (int32) i < saved_buckets - loaded_buckets ? NULL
+                                     : get_tier_bucket(j, i - (saved_buckets - loaded_buckets)), &crc))
+                goto error;
+        }
+        if (loaded_buckets > 0)
+            pg_atomic_write_u64(&tier->current_bucket, loaded_buckets - 1);
+    }
+
+    FIN_CRC32C(crc);
+    if (fread(&saved_crc, sizeof(saved_crc), 1, file) != 1 || !EQ_CRC32C(crc, saved_crc))
+        goto error;
+    FreeFile(file);
+    unlink(logerrors_dump_file);
+    return;
+
+error:
+    ereport(LOG,
+            (errmsg("ignoring invalid data in file \"%s\"", logerrors_dump_file)));
+    FreeFile(file);
+    unlink(logerrors_dump_file);
+    /* Part of statistics may be loaded already */
+    backend_counters_init();
+    slow_log_histograms_init();
+    principals_init();
+    sources_init();
+    class_counters_init();
+    logerrors_init();
+}
+
+/* Backends stop waking the worker up once it exits */
+static void
+logerrors_worker_exit(int code, Datum arg)
+{
+    global_variables->worker_latch = NULL;
+}
+
+/* Close the interval and plan the next tick, only the worker calls it */
+static void
+logerrors_tick(TimestampTz *next_tick, int *intervals_since_save)
+{
+    TimestampTz now = logerrors_now();
+    /* Main work happens here */
+    logerrors_update_info();
+    internal_stats_tick(now - *next_tick, logerrors_now() - now);
+    *next_tick = TimestampTzPlusMilliseconds(*next_tick, interval);
+    /* Don't catch up with ticks missed while the server was stuck */
+    if (*next_tick <= now)
+        *next_tick = TimestampTzPlusMilliseconds(now, interval);
+    if (save_stats && save_intervals > 0 && ++*intervals_since_save >= save_intervals) {
+        logerrors_save();
+        *intervals_since_save = 0;
+    }
+}
+
+void
+logerrors_main(Datum main_arg)
+{
+    int intervals_since_save = 0;
+    TimestampTz next_tick;
+    TimestampTz now;
+    long secs;
+    int usecs;
+
+    /* Register functions for SIGTERM management */
+    pqsignal(SIGTERM, logerrors_sigterm);
+    pqsignal(SIGHUP, logerrors_sighup);
+
+    /* We're now ready to receive signals */
     BackgroundWorkerUnblockSignals();
 
-    logerrors_init();
-    while (!got_sigterm)
-    {
-        int rc;
-        /* Wait necessary amount of time */
-        rc = WaitLatch(&MyProc->procLatch,
-#if PG_VERSION_NUM < 100000
-                       WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH, interval);
-#else
-                       WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH, interval, PG_WAIT_EXTENSION);
-#endif
+    /* Statistics are initialized or loaded by postmaster, keep them on restart of the worker */
+    intervals_ring_attach(false);
+    intervals_ring_resize();
+    alert_rules_build();
+    class_counters_start(false);
+    global_variables->worker_latch = &MyProc->procLatch;
+    before_shmem_exit(logerrors_worker_exit, (Datum) 0);
+    next_tick = TimestampTzPlusMilliseconds(logerrors_now(), interval);
+    while (!got_sigterm)
+    {
+        int rc;
+        int events = WL_LATCH_SET | WL_POSTMASTER_DEATH;
+        long timeout = -1L;
+        /* Wait until the deadline, so time spent on a tick doesn't shift the next ones */
+        if (!manual_clock) {
+            TimestampDifference(GetCurrentTimestamp(), next_tick, &secs, &usecs);
+            events |= WL_TIMEOUT;
+            timeout = secs * 1000 + usecs / 1000;
+        }
+        rc = WaitLatch(&MyProc->procLatch,
+#if PG_VERSION_NUM < 100000
+                       events, timeout);
+#else
+                       events, timeout, PG_WAIT_EXTENSION);
+#endif
+
+        ResetLatch(&MyProc->procLatch);
+        /* Emergency bailout if postmaster has died */
+        if (rc & WL_POSTMASTER_DEATH)
+            proc_exit(1);
+        /* Process signals */
+
+        if (got_sigterm)
+        {
+            elog(DEBUG1, "bgworker logerrors signal: processed SIGTERM");
+            if (save_stats)
+                logerrors_save();
+            proc_exit(0);
+        }
+        if (got_sighup)
+        {
+            got_sighup = false;
+            ProcessConfigFile(PGC_SIGHUP);
+            errcodes_filter_build();
+            dimensions_build();
+            alert_rules_build();
+            intervals_ring_resize();
+        }
+        /* A backfill wakes the worker up to apply what it passed */
+        backfill_queue_drain();
+        if (manual_clock) {
+            /* A requested tick moves the clock to its deadline, as if the interval has passed */
+            while (!got_sigterm && pg_atomic_read_u64(&global_variables->done_ticks) <
+                                   pg_atomic_read_u64(&global_variables->requested_ticks)) {
+                now = logerrors_now();
+                if (now < next_tick)
+                    pg_atomic_write_u64(&global_variables->clock_offset,
+                                        pg_atomic_read_u64(&global_variables->clock_offset) + (next_tick - now));
+                logerrors_tick(&next_tick, &intervals_since_save);
+                pg_atomic_write_u64(&global_variables->done_ticks,
+                                    pg_atomic_read_u64(&global_variables->done_ticks) + 1);
+            }
+            continue;
+        }
+        /* Interval isn't over if only woken up by a signal */
+        if (logerrors_now() < next_tick)
+            continue;
+        logerrors_tick(&next_tick, &intervals_since_save);
+    }
+
+    /* No problems, so clean exit */
+    proc_exit(0);
+}
+
+#define fingerprint_hash_step(hash, byte) \
+    ((hash) = ((hash) ^ (uint8) (byte)) * UINT64CONST(0x100000001b3))
+
+/*
+ * FNV-1a hash of message type, code and message format. If the format is
+ * just "%s", as in RAISE, message text is used instead. Digits and quoted
+ * literals are replaced, so messages which differ only in values have the
+ * same fingerprint.
+ */
+static uint64
+message_fingerprint(ErrorData *edata, int message_type_index)
+{
+    uint64 hash = UINT64CONST(0xcbf29ce484222325);
+    const char *c;
+    char quote = '\0';
+    bool in_number = false;
+    int i;
+    for (i = 0; i < sizeof(edata->sqlerrcode); ++i)
+        fingerprint_hash_step(hash, edata->sqlerrcode >> (i * 8));
+    fingerprint_hash_step(hash, message_type_index);
+    if (edata->message_id != NULL && strcmp(edata->message_id, "%s") != 0)
+        c = edata->message_id;
+    else if (edata->message != NULL)
+        c = edata->message;
+    else
+        c = "";
+    for (; *c != '\0'; ++c) {
+        if (quote != '\0') {
+            if (*c == quote)
+                quote = '\0';
+            continue;
+        }
+        if (*c == '\'' || *c == '"') {
+            quote = *c;
+            fingerprint_hash_step(hash, '?');
+            continue;
+        }
+        if (*c >= '0' && *c <= '9') {
+            if (!in_number)
+                fingerprint_hash_step(hash, '0');
+            in_number = true;
+            continue;
+        }
+        in_number = false;
+        fingerprint_hash_step(hash, *c);
+    }
+    return hash;
+}
+
+/* Log hook */
+void
+logerrors_emit_log_hook(ErrorData *edata)
+{
+    int lvl_i;
+    uint64 duration_us;
+    SlowLogHistogram *histogram;
+    uint64 hook_time_ns;
+    bool timed;
+    bool shared;
+    instr_time start_time;
+    instr_time duration;
+    BackendCounters *counters;
+    /* Only if hashtable already inited */
+    if (global_variables != NULL && backends_buffer != NULL && MyProc != NULL &&
+        !proc_exit_inprogress && !got_sigterm) {
+        counters = get_own_backend_counters(&shared);
+        backend_counter_add(&counters->hook_calls, 1, shared);
+        timed = (++hook_calls_count % hook_timing_sample == 0);
+        if (timed)
+            INSTR_TIME_SET_CURRENT(start_time);
+        for (lvl_i = 0; lvl_i < message_types_count; ++lvl_i)
+        {
+            /* Only current message type */
+            if (edata->elevel != message_types_codes[lvl_i])
+                continue;
+            if (!errcodes_filter_counts(edata->sqlerrcode)) {
+                backend_counter_add(&counters->filtered_count, 1, shared);
+                continue;
+            }
+            add_message(counters, shared, edata->sqlerrcode, MyDatabaseId, GetUserId(), get_own_source(),
+                        lvl_i, edata);
+        }
+        if (edata && edata->message)
+        {
+            /*
+             * pg_slow_log_stats() counts messages with "duration:" anywhere
+             * in them as before, only ones starting with a duration go to
+             * histograms.
+             */
+            if (parse_duration_message(edata->message, &duration_us)) {
+                pg_atomic_fetch_add_u32(&global_variables->slow_log_info.count, 1);
+                histogram = get_slow_log_histogram(MyDatabaseId, GetUserId());
+                if (histogram != NULL)
+                    pg_atomic_fetch_add_u32(&histogram->buckets[slow_log_bucket(duration_us)], 1);
+            } else if (strstr(edata->message, "duration:"))
+                pg_atomic_fetch_add_u32(&global_variables->slow_log_info.count, 1);
+        }
+        if (timed) {
+            INSTR_TIME_SET_CURRENT(duration);
+            INSTR_TIME_SUBTRACT(duration, start_time);
+            hook_time_ns = (uint64) (INSTR_TIME_GET_DOUBLE(duration) * 1000000000.0);
+            backend_counter_add(&counters->timed_calls, 1, shared);
+            backend_counter_add(&counters->hook_time_ns, hook_time_ns, shared);
+            /* Processes without a slot of their own may lose a max to each other */
+            if (hook_time_ns > pg_atomic_read_u64(&counters->hook_time_max_ns))
+                pg_atomic_write_u64(&counters->hook_time_max_ns, hook_time_ns);
+        }
+    }
+
+    if (prev_emit_log_hook) {
+        prev_emit_log_hook(edata);
+    }
+}
+
+static void
+logerrors_load_params(void)
+{
+    DefineCustomIntVariable("logerrors.interval",
+                            "Time between writing stat to buffer (ms).",
+                            "Default of 5s, max of 60s",
+                            &interval,
+                            5000,
+                            1000,
+                            60000,
+                            PGC_SIGHUP,
+                            GUC_UNIT_MS | GUC_NO_RESET_ALL,
+                            NULL,
+                            NULL,
+                            NULL);
+    DefineCustomIntVariable("logerrors.intervals_count",
+                            "Count of intervals in buffer",
+                            "Default of 120, max of 360",
+                            &intervals_count,
+                            120,
+                            2,
+                            max_intervals_count,
+                            PGC_SIGHUP,
+                            GUC_NO_RESET_ALL,
+                            NULL,
+                            NULL,
+                            NULL);
+    DefineCustomIntVariable("logerrors.interval_slots",
+                            "Count of distinct messages counted in one interval",
+                            "Messages beyond it are counted as OVERFLOW. Default of 512, max of 16384",
+                            &interval_slots,
+                            512,
+                            16,
+                            max_interval_slots,
+                            PGC_POSTMASTER,
+                            GUC_NO_RESET_ALL,
+                            NULL,
+                            NULL,
+                            NULL);
+    DefineCustomBoolVariable("logerrors.save",
+                             "Save statistics across server shutdowns",
+                             NULL,
+                             &save_stats,
+                             true,
+                             PGC_SIGHUP,
+                             GUC_NO_RESET_ALL,
+                             NULL,
+                             NULL,
+                             NULL);
+    DefineCustomIntVariable("logerrors.save_intervals",
+                            "Count of intervals between saving statistics",
+                            "Default of 0 saves them only on shutdown, max of 360",
+                            &save_intervals,
+                            0,
+                            0,
+                            max_intervals_count,
+                            PGC_SIGHUP,
+                            GUC_NO_RESET_ALL,
+                            NULL,
+                            NULL,
+                            NULL);
+    DefineCustomIntVariable("logerrors.minute_buckets",
+                            "Count of minute buckets closed intervals are rolled up into",
+                            "A bucket takes about 18 bytes of shared memory per tier slot. "
+                            "Default of 180 keeps 3 hours, max of 10080, 0 disables them",
+                            &minute_buckets,
+                            180,
+                            0,
+                            max_tier_buckets,
+                            PGC_POSTMASTER,
+                            GUC_NO_RESET_ALL,
+                            NULL,
+                            NULL,
+                            NULL);
+    DefineCustomIntVariable("logerrors.hour_buckets",
+                            "Count of hour buckets closed intervals are rolled up into",
+                            "A bucket takes about 18 bytes of shared memory per tier slot. "
+                            "Default of 168 keeps a week, max of 10080, 0 disables them",
+                            &hour_buckets,
+                            168,
+                            0,
+                            max_tier_buckets,
+                            PGC_POSTMASTER,
+                            GUC_NO_RESET_ALL,
+                            NULL,
+                            NULL,
+                            NULL);
+    DefineCustomIntVariable("logerrors.tier_slots",
+                            "Count of distinct messages counted in one minute or hour bucket",
+                            "Messages beyond it are counted as OVERFLOW. Default of 128, max of 16384",
+                            &tier_slots,
+                            128,
+                            16,
+                            max_interval_slots,
+                            PGC_POSTMASTER,
+                            GUC_NO_RESET_ALL,
+                            NULL,
+                            NULL,
+                            NULL);
+    DefineCustomIntVariable("logerrors.sample_threshold",
+                            "Count of messages of one kind a backend counts one by one in an interval",
+                            "Beyond it messages are sampled and their counts are estimated, "
+                            "TOTAL stays exact. Default of 0 counts all messages",
+                            &sample_threshold,
+                            0,
+                            0,
+                            INT_MAX,
+                            PGC_SIGHUP,
+                            GUC_NO_RESET_ALL,
+                            NULL,
+                            NULL,
+                            NULL);
+    DefineCustomBoolVariable("logerrors.manual_clock",
+                             "Close intervals only by pg_log_errors_advance_interval()",
+                             "For tests and benchmarks, each call moves time of logerrors forward",
+                             &manual_clock,
+                             false,
+                             PGC_POSTMASTER,
+                             GUC_NO_RESET_ALL,
+                             NULL,
+                             NULL,
+                             NULL);
+    DefineCustomStringVariable("logerrors.excluded_errcodes",
+                               "Excluded error codes separated by ','",
+                               "Class of codes is excluded by \"57***\"",
+                               &excluded_errcodes_str,
+                               NULL,
+                               PGC_SIGHUP,
+                               GUC_NO_RESET_ALL,
+                               NULL,
+                               NULL,
+                               NULL);
+    DefineCustomStringVariable("logerrors.included_errcodes",
+                               "If set, only these error codes separated by ',' are counted",
+                               "Class of codes is included by \"57***\"",
+                               &included_errcodes_str,
+                               NULL,
+                               PGC_SIGHUP,
+                               GUC_NO_RESET_ALL,
+                               NULL,
+                               NULL,
+                               NULL);
+    DefineCustomStringVariable("logerrors.dimensions",
+                               "Dimensions messages are told apart by besides database and user, separated by ','",
+                               "application_name, backend_type and client_addr",
+                               &dimensions_str,
+                               NULL,
+                               PGC_SIGHUP,
+                               GUC_NO_RESET_ALL,
+                               NULL,
+                               NULL,
+                               NULL);
+    DefineCustomStringVariable("logerrors.alert_rules",
+                               "Rules of alerts on counts of messages in an interval, separated by ','",
+                               "Like \"40P01 > 10\" for a count or \"* > 3 sigma\" for standard deviations above baseline",
+                               &alert_rules_str,
+                               NULL,
+                               PGC_SIGHUP,
+                               GUC_NO_RESET_ALL,
+                               NULL,
+                               NULL,
+                               NULL);
+    DefineCustomIntVariable("logerrors.alert_baseline_intervals",
+                            "Count of intervals baselines of alerts mostly remember",
+                            "Weight of an interval in the moving mean and variance is 2 / (count + 1)",
+                            &alert_baseline_intervals,
+                            60,
+                            1,
+                            100000,
+                            PGC_SIGHUP,
+                            GUC_NO_RESET_ALL,
+                            NULL,
+                            NULL,
+                            NULL);
+}
+/*
+ * Entry point for worker loading
+ */
+void
+_PG_init(void)
+{
+    BackgroundWorker worker;
+    if (!process_shared_preload_libraries_in_progress) {
+        return;
+    }
+    /* Shared memory size depends on parameters */
+    logerrors_load_params();
+    error_classes_build();
+    prev_shmem_startup_hook = shmem_startup_hook;
+    shmem_startup_hook = logerrors_shmem_startup;
+    prev_emit_log_hook = emit_log_hook;
+    emit_log_hook = logerrors_emit_log_hook;
+    RegisterXactCallback(logerrors_xact_callback, NULL);
+#if (PG_VERSION_NUM >= 150000)
+    prev_shmem_request_hook = shmem_request_hook;
+    shmem_request_hook = logerrors_shmem_request;
+#else
+    RequestAddinShmemSpace(logerrors_memsize());
+#endif
+    /* Worker parameter and registration */
+    MemSet(&worker, 0, sizeof(BackgroundWorker));
+    worker.bgw_flags = BGWORKER_SHMEM_ACCESS;
+    worker.bgw_start_time = BgWorkerStart_PostmasterStart;
+    snprintf(worker.bgw_name, BGW_MAXLEN, "%s", worker_name);
+    sprintf(worker.bgw_library_name, "logerrors");
+    sprintf(worker.bgw_function_name, "logerrors_main");
+    /* Wait 10 seconds for restart after crash */
+    worker.bgw_restart_time = 10;
+    worker.bgw_main_arg = (Datum) 0;
+    worker.bgw_notify_pid = 0;
+    RegisterBackgroundWorker(&worker);
+}
+
+void
+_PG_fini(void)
+{
+    emit_log_hook = prev_emit_log_hook;
+    shmem_startup_hook = prev_shmem_startup_hook;
+}
+
+static Size
+logerrors_memsize(void)
+{
+    Size size;
+    size = MAXALIGN(sizeof(GlobalInfo));
+#if PG_VERSION_NUM >= 100000
+    ring_place_count = intervals_count + 5;
+#else
+    /* No dynamic shared memory, the ring is allocated for any intervals_count */
+    ring_place_count = max_actual_intervals_count;
+#endif
+    size = add_size(size, mul_size(ring_place_count, interval_counters_size(interval_slots)));
+    size = add_size(size, interval_counters_size(get_window_slots()));
+    size = add_size(size, mul_size(get_backends_count() + 1, backend_counters_size));
+    size = add_size(size, MAXALIGN(sizeof(SlowLogHistograms)));
+    size = add_size(size, MAXALIGN(sizeof(HeavyHitters)));
+    size = add_size(size, MAXALIGN(sizeof(CumulativeCounters)));
+    size = add_size(size, MAXALIGN(sizeof(Principals)));
+    size = add_size(size, MAXALIGN(sizeof(Sources)));
+    size = add_size(size, tiers_buffer_size());
+    size = add_size(size, MAXALIGN(sizeof(BackfillQueue)));
+    size = add_size(size, MAXALIGN(sizeof(AlertEvents)));
+    size = add_size(size, MAXALIGN(sizeof(ClassCounters)));
+    return size;
+}
+
+static void
+logerrors_shmem_startup(void) {
+    bool found;
+    if (prev_shmem_startup_hook)
+        prev_shmem_startup_hook();
+    global_variables = NULL;
+    ring_place = NULL;
+    intervals_buffer = NULL;
+    window_counters = NULL;
+    backends_buffer = NULL;
+    slow_log_histograms = NULL;
+    heavy_hitters = NULL;
+    cumulative_counters = NULL;
+    principals = NULL;
+    sources = NULL;
+    tiers_buffer = NULL;
+    backfill_queue = NULL;
+    alert_events = NULL;
+    class_counters = NULL;
+    global_variables = ShmemInitStruct("logerrors global_variables",
+                                       sizeof(GlobalInfo),
+                                       &found);
+    if (IsUnderPostmaster)
+        ring_place_count = global_variables->ring_place_count;
+    ring_place = ShmemInitStruct("logerrors intervals",
+                                 mul_size(ring_place_count, interval_counters_size(interval_slots)),
+                                 &found);
+    window_counters = ShmemInitStruct("logerrors window",
+                                      interval_counters_size(get_window_slots()),
+                                      &found);
+    backends_buffer = ShmemInitStruct("logerrors backends",
+                                      mul_size(get_backends_count() + 1, backend_counters_size),
+                                      &found);
+    slow_log_histograms = ShmemInitStruct("logerrors slow log histograms",
+                                          sizeof(SlowLogHistograms),
+                                          &found);
+    heavy_hitters = ShmemInitStruct("logerrors heavy hitters",
+                                    sizeof(HeavyHitters),
+                                    &found);
+    cumulative_counters = ShmemInitStruct("logerrors cumulative counters",
+                                          sizeof(CumulativeCounters),
+                                          &found);
+    principals = ShmemInitStruct("logerrors principals",
+                                 sizeof(Principals),
+                                 &found);
+    sources = ShmemInitStruct("logerrors sources",
+                              sizeof(Sources),
+                              &found);
+    tiers_buffer = ShmemInitStruct("logerrors rollup tiers",
+                                   tiers_buffer_size(),
+                                   &found);
+    backfill_queue = ShmemInitStruct("logerrors backfill",
+                                     sizeof(BackfillQueue),
+                                     &found);
+    alert_events = ShmemInitStruct("logerrors alerts",
+                                   sizeof(AlertEvents),
+                                   &found);
+    class_counters = ShmemInitStruct("logerrors class counters",
+                                     sizeof(ClassCounters),
+                                     &found);
+    if (!IsUnderPostmaster) {
+        global_variables_init();
+        intervals_ring_attach(false);
+        backend_counters_init();
+        slow_log_histograms_init();
+        SpinLockInit(&heavy_hitters->mutex);
+        SpinLockInit(&cumulative_counters->mutex);
+        principals_init();
+        sources_init();
+        rollup_tiers_init();
+        backfill_queue_init();
+        alert_events_init();
+        class_counters_init();
+        logerrors_init();
+        if (save_stats)
+            logerrors_load();
+        else
+            unlink(logerrors_dump_file);
+    }
+    return;
+}
+
+#if (PG_VERSION_NUM >= 150000)
+/*
+ * Requests any additional shared memory required for our extension
+ */
+static void
+logerrors_shmem_request(void)
+{
+    if (prev_shmem_request_hook)
+        prev_shmem_request_hook();
+
+    RequestAddinShmemSpace(logerrors_memsize());
+}
+#endif
+
+PG_FUNCTION_INFO_V1(pg_log_errors_stats);
+
+/* Count up intervals from scratch, as the worker does on window rebuild */
+static void
+count_up_errors(int duration_in_intervals, int current_interval, HTAB* counters_hashtable, uint32* overflow_count) {
+    bool found;
+    int i;
+    int k;
+    uint32 j;
+    uint32 entries_count;
+    int interval_index;
+    IntervalCounters* counters;
+    CounterEntry* entries;
+    CounterHashElem* elem;
+    if (global_variables == NULL || counters_hashtable == NULL){
+        return;
+    }
+    /* put all counters to hashtable */
+    for (i = duration_in_intervals; i > 0; --i) {
+        interval_index = (current_interval - i + ring_intervals_count)
+                % ring_intervals_count;
+        counters = get_interval_counters(interval_index);
+        entries = interval_counters_entries(counters);
+        for (k = 0; k < message_types_count; ++k) {
+            overflow_count[k] += pg_atomic_read_u32(&counters->overflow_count[k]);
+        }
+        entries_count = pg_atomic_read_u32(&counters->entries_count);
+        pg_read_barrier();
+        for (j = 0; j < entries_count; ++j) {
+            elem = hash_search(counters_hashtable, (void *) &entries[j].key, HASH_ENTER, &found);
+            if (!found) {
+                elem->counter = 0;
+            }
+            elem->counter += pg_atomic_read_u32(&entries[j].counter);
+        }
+    }
+}
+
+static Tuplestorestate *
+begin_result_tuplestore(FunctionCallInfo fcinfo, TupleDesc *tupdesc)
+{
+    ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+    Tuplestorestate *tupstore;
+    MemoryContext per_query_ctx;
+    MemoryContext oldcontext;
+
+    /* Shmem structs not ready yet */
+    if (global_variables == NULL || slow_log_histograms == NULL) {
+        ereport(ERROR,
+                (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+                        errmsg("logerrors must be loaded via shared_preload_libraries")));
+    }
+    intervals_ring_attach(true);
+    /* check to see if caller supports us returning a tuplestore */
+    if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+        ereport(ERROR,
+                (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+                        errmsg("set-valued function called in context that cannot accept a set")));
+    if (!(rsinfo->allowedModes & SFRM_Materialize))
+        ereport(ERROR,
+                (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+                        errmsg("materialize mode required, but it is not allowed in this context")));
+
+    /* Build a tuple descriptor for our result type */
+    if (get_call_result_type(fcinfo, NULL, tupdesc) != TYPEFUNC_COMPOSITE)
+        ereport(ERROR,
+                (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+                        errmsg("return type must be a row type")));
+
+    per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+    oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+    tupstore = tuplestore_begin_heap(true, false, work_mem);
+    rsinfo->returnMode = SFRM_Materialize;
+    rsinfo->setResult = tupstore;
+    rsinfo->setDesc = *tupdesc;
+    MemoryContextSwitchTo(oldcontext);
+    return tupstore;
+}
+
+/* Binary search in error_codes generated from errcodes.txt */
+static const char *
+get_error_name(int error_code)
+{
+    int low = 0;
+    int high = error_codes_count - 1;
+    int middle;
+    while (low <= high) {
+        middle = (low + high) / 2;
+        if (error_codes[middle] == error_code)
+            return &error_names[error_name_offsets[middle]];
+        if (error_codes[middle] < error_code)
+            low = middle + 1;
+        else
+            high = middle - 1;
+    }
+    return "NOT_KNOWN_ERROR";
+}
+
+/* Rows of pg_log_errors_stats_filtered(), InvalidOid and -1 match everything */
+typedef struct stats_filter {
+    Oid db_oid;
+    Oid user_oid;
+    int message_type_index;
+    int error_code;
+} StatsFilter;
+
+/* Text of a name or of an error code, made once per call */
+typedef struct name_cache_entry {
+    uint32 key;
+    bool isnull;
+    Datum name;
+    /* SQLSTATE of error code */
+    Datum sqlstate;
+} NameCacheEntry;
+
+/* Caches of database, user and error names of one call */
+typedef struct names_cache {
+    HTAB *databases;
+    HTAB *users;
+    HTAB *error_codes;
+} NamesCache;
+
+static HTAB *
+names_cache_create(const char *name)
+{
+    HASHCTL ctl;
+    memset(&ctl, 0, sizeof(ctl));
+    ctl.keysize = sizeof(uint32);
+    ctl.entrysize = sizeof(NameCacheEntry);
+    /* Freed together with the call */
+    ctl.hcxt = CurrentMemoryContext;
+#if PG_VERSION_NUM < 100000
+    return hash_create(name, 64, &ctl, HASH_ELEM | HASH_CONTEXT);
+#else
+    return hash_create(name, 64, &ctl, HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+#endif
+}
+
+static void
+names_cache_init(NamesCache *cache)
+{
+    cache->databases = names_cache_create("logerrors database names");
+    cache->users = names_cache_create("logerrors user names");
+    cache->error_codes = names_cache_create("logerrors error names");
+}
+
+static NameCacheEntry *
+get_database_name_cached(NamesCache *cache, Oid db_oid)
+{
+    NameCacheEntry *entry;
+    char *name;
+    bool found;
+    entry = hash_search(cache->databases, (void *) &db_oid, HASH_ENTER, &found);
+    if (!found) {
+        name = get_database_name(db_oid);
+        entry->isnull = (name == NULL);
+        if (name != NULL)
+            entry->name = CStringGetTextDatum(name);
+    }
+    return entry;
+}
+
+static NameCacheEntry *
+get_user_name_cached(NamesCache *cache, Oid user_oid)
+{
+    NameCacheEntry *entry;
+    char *name;
+    bool found;
+    entry = hash_search(cache->users, (void *) &user_oid, HASH_ENTER, &found);
+    if (!found) {
+        name = get_user_by_oid(user_oid);
+        entry->isnull = (name == NULL);
+        if (name != NULL)
+            entry->name = CStringGetTextDatum(name);
+    }
+    return entry;
+}
+
+static NameCacheEntry *
+get_error_name_cached(NamesCache *cache, int error_code)
+{
+    NameCacheEntry *entry;
+    bool found;
+    entry = hash_search(cache->error_codes, (void *) &error_code, HASH_ENTER, &found);
+    if (!found) {
+        entry->isnull = false;
+        entry->name = CStringGetTextDatum(get_error_name(error_code));
+        entry->sqlstate = CStringGetTextDatum(unpack_sql_state(error_code));
+    }
+    return entry;
+}
+
+/* Rows which aren't about one database, user and code pass only an empty filter of them */
+static bool
+stats_filter_by_type_only(const StatsFilter *filter)
+{
+    return filter->db_oid == InvalidOid && filter->user_oid == InvalidOid && filter->error_code == -1;
+}
+
+/*
+ * Copy interval out of shared memory. The worker changes intervals only
+ * between interval_counters_begin_change() and end_change(), a copy which
+ * overlaps that is made again, so it never has half-cleared entries or
+ * times of another interval.
+ */
+static void
+copy_interval(IntervalCounters *counters, TimestampTz *start_time, TimestampTz *end_time,
+              uint64 *sequence, MessageCount *entries, uint32 *entries_count, uint32 *overflow_count)
+{
+    CounterEntry *counter_entries = interval_counters_entries(counters);
+    uint32 change_count;
+    uint32 i;
+    for (;;) {
+        change_count = pg_atomic_read_u32(&counters->change_count);
+        if (change_count % 2 != 0) {
+            CHECK_FOR_INTERRUPTS();
+            pg_usleep(1000L);
+            continue;
+        }
+        pg_read_barrier();
+        *start_time = (TimestampTz) pg_atomic_read_u64(&counters->start_time);
+        *end_time = (TimestampTz) pg_atomic_read_u64(&counters->end_time);
+        *sequence = pg_atomic_read_u64(&counters->sequence);
+        *entries_count = Min(pg_atomic_read_u32(&counters->entries_count), (uint32) counters->slots);
+        pg_read_barrier();
+        for (i = 0; i < *entries_count; ++i) {
+            message_key_unpack(&counter_entries[i].key, &entries[i].key);
+            entries[i].count = pg_atomic_read_u32(&counter_entries[i].counter);
+            entries[i].estimated = interval_counters_estimated(counters)[i];
+        }
+        for (i = 0; i < message_types_count; ++i)
+            overflow_count[i] = pg_atomic_read_u32(&counters->overflow_count[i]);
+        pg_read_barrier();
+        if (pg_atomic_read_u32(&counters->change_count) == change_count)
+            return;
+    }
+}
+
+/*
+ * Copy closed interval out of shared memory. Returns false if the interval
+ * is open. A bucket of a rollup tier is copied while it is filling,
+ * end_time is the end of the last interval added to it then.
+ */
+static bool
+copy_closed_interval(IntervalCounters *counters, TimestampTz *start_time, TimestampTz *end_time,
+                     uint64 *sequence, MessageCount *entries, uint32 *entries_count, uint32 *overflow_count)
+{
+    copy_interval(counters, start_time, end_time, sequence, entries, entries_count, overflow_count);
+    return *end_time != 0;
+}
+
+/* Application name, backend type and client address of a source, NULL if not asked for */
+static void
+put_source_values(uint32 source, Datum *values, bool *nulls)
+{
+    const Source *entry = &sources->entries[Min(source, sources_count)];
+    nulls[0] = (entry->application_name[0] == '\0');
+    if (!nulls[0])
+        values[0] = CStringGetTextDatum(entry->application_name);
+    nulls[1] = (entry->backend_type < 0);
+#if PG_VERSION_NUM >= 130000
+    if (!nulls[1])
+        values[1] = CStringGetTextDatum(GetBackendTypeDesc((BackendType) entry->backend_type));
+#endif
+    nulls[2] = (entry->client_addr[0] == '\0');
+    if (!nulls[2])
+        values[2] = CStringGetTextDatum(entry->client_addr);
+}
+
+/* Returns count of entries scanned */
+static uint32
+put_values_to_tuple(
+        IntervalCounters* counters,
+        int duration_in_intervals,
+        const StatsFilter *filter,
+        NamesCache *names_cache,
+        MessageCount *entries,
+        TupleDesc tupdesc,
+        Tuplestorestate *tupstore){
+#define logerrors_COLS	13
+    Datum long_interval_values[logerrors_COLS];
+    bool long_interval_nulls[logerrors_COLS];
+    uint32 entries_count;
+    uint32 overflow_count[message_types_count];
+    TimestampTz start_time;
+    TimestampTz end_time;
+    uint64 sequence;
+    uint32 j;
+    uint32 count;
+    int k;
+    NameCacheEntry *name_entry;
+    MessageInfo key;
+    if (global_variables == NULL || counters == NULL){
+        return 0;
+    }
+    copy_interval(counters, &start_time, &end_time, &sequence, entries, &entries_count, overflow_count);
+    /* Entries are in order of first appearance of the message */
+    for (j = 0; j < entries_count; ++j) {
+        key = entries[j].key;
+        count = entries[j].count;
+        if (count == 0) {
+            /* This kind of message already left the window */
+            continue;
+        }
+        /* Filter before any lookup of names */
+        if ((filter->db_oid != InvalidOid && key.db_oid != filter->db_oid) ||
+            (filter->user_oid != InvalidOid && key.user_oid != filter->user_oid) ||
+            (filter->message_type_index != -1 && key.message_type_index != filter->message_type_index) ||
+            (filter->error_code != -1 && key.error_code != filter->error_code))
+            continue;
+
+        MemSet(long_interval_values, 0, sizeof(long_interval_values));
+        MemSet(long_interval_nulls, 0, sizeof(long_interval_nulls));
+        for (k = 0; k < logerrors_COLS; ++k) {
+            long_interval_nulls[k] = false;
+        }
+        /* Time interval */
+        long_interval_values[0] = DatumGetInt32(global_variables->interval * duration_in_intervals / 1000);
+        /* Type */
+        long_interval_values[1] = CStringGetTextDatum(message_type_names[key.message_type_index]);
+        /* Message and SQLState */
+        name_entry = get_error_name_cached(names_cache, key.error_code);
+        long_interval_values[2] = name_entry->name;
+        long_interval_values[6] = name_entry->sqlstate;
+        /* Count */
+        long_interval_values[3] = DatumGetInt32(count);
+        /* Username */
+        name_entry = get_user_name_cached(names_cache, key.user_oid);
+        long_interval_nulls[4] = name_entry->isnull;
+        long_interval_values[4] = name_entry->name;
+        /* Database name */
+        name_entry = get_database_name_cached(names_cache, key.db_oid);
+        long_interval_nulls[5] = name_entry->isnull;
+        long_interval_values[5] = name_entry->name;
+        /* Database and user oids, estimated and dimensions, only pg_log_errors_stats_filtered() has them */
+        long_interval_values[7] = ObjectIdGetDatum(key.db_oid);
+        long_interval_values[8] = ObjectIdGetDatum(key.user_oid);
+        long_interval_values[9] = BoolGetDatum(entries[j].estimated > 0);
+        put_source_values(key.source, &long_interval_values[10], &long_interval_nulls[10]);
+
+        tuplestore_putvalues(tupstore, tupdesc, long_interval_values, long_interval_nulls);
+    }
+    if (!stats_filter_by_type_only(filter))
+        return entries_count;
+    /* Messages which didn't fit into interval slots, counted only by type */
+    for (k = 0; k < message_types_count; ++k) {
+        count = overflow_count[k];
+        if (count == 0 || (filter->message_type_index != -1 && k != filter->message_type_index))
+            continue;
+        MemSet(long_interval_values, 0, sizeof(long_interval_values));
+        MemSet(long_interval_nulls, 0, sizeof(long_interval_nulls));
+        /* Time interval */
+        long_interval_values[0] = DatumGetInt32(global_variables->interval * duration_in_intervals / 1000);
+        /* Type */
+        long_interval_values[1] = CStringGetTextDatum(message_type_names[k]);
+        /* Message */
+        long_interval_values[2] = CStringGetTextDatum("OVERFLOW");
+        /* Count */
+        long_interval_values[3] = DatumGetInt32(count);
+        /* Username, database name, sqlstate, oids and whether it is estimated are unknown */
+        long_interval_nulls[4] = true;
+        long_interval_nulls[5] = true;
+        long_interval_nulls[6] = true;
+        long_interval_nulls[7] = true;
+        long_interval_nulls[8] = true;
+        long_interval_nulls[9] = true;
+        long_interval_nulls[10] = true;
+        long_interval_nulls[11] = true;
+        long_interval_nulls[12] = true;
+        tuplestore_putvalues(tupstore, tupdesc, long_interval_values, long_interval_nulls);
+    }
+    return entries_count;
+}
+
+static Datum
+log_errors_stats(FunctionCallInfo fcinfo, const StatsFilter *filter)
+{
+    TupleDesc	tupdesc;
+    Tuplestorestate *tupstore;
+    Datum long_interval_values[logerrors_COLS];
+
+    bool long_interval_nulls[logerrors_COLS];
+    NamesCache names_cache;
+    MessageCount *entries;
+    int current_interval_index;
+    int lvl_i;
+    int j;
+    uint32 entries_scanned = 0;
+    instr_time start_time;
+    instr_time duration;
+
+    tupstore = begin_result_tuplestore(fcinfo, &tupdesc);
+    names_cache_init(&names_cache);
+    INSTR_TIME_SET_CURRENT(start_time);
+
+    current_interval_index = pg_atomic_read_u64(&global_variables->messagesBuffer.current_interval_index) % (uint64)ring_intervals_count;
+    /* 'TOTAL' counters */
+    for (lvl_i = 0; lvl_i < message_types_count && stats_filter_by_type_only(filter); ++lvl_i) {
+        if (filter->message_type_index != -1 && lvl_i != filter->message_type_index)
+            continue;
+
+        /* Add total count to result */
+        MemSet(long_interval_values, 0, sizeof(long_interval_values));
+        MemSet(long_interval_nulls, 0, sizeof(long_interval_nulls));
+        for (j = 0; j < logerrors_COLS; ++j) {
+            long_interval_nulls[j] = false;
+        }
+        /* Time interval */
+        long_interval_nulls[0] = true;
+        /* Type */
+        long_interval_values[1] = CStringGetTextDatum(message_type_names[lvl_i]);
+        /* Message */
+        long_interval_values[2] = CStringGetTextDatum("TOTAL");
+        /* Count */
+        long_interval_values[3] = DatumGetInt32((uint32) get_total_count(lvl_i));
+        /* Username */
+        long_interval_nulls[4] = true;
+        /* Database name */
+        long_interval_nulls[5] = true;
+        /* sqlstate */
+        long_interval_nulls[6] = true;
+        /* oids */
+        long_interval_nulls[7] = true;
+        long_interval_nulls[8] = true;
+        /* Totals are never sampled */
+        long_interval_values[9] = BoolGetDatum(false);
+        /* Dimensions */
+        long_interval_nulls[10] = true;
+        long_interval_nulls[11] = true;
+        long_interval_nulls[12] = true;
+        tuplestore_putvalues(tupstore, tupdesc, long_interval_values, long_interval_nulls);
+    }
+    /* Until the worker applies reset there is nothing counted since it */
+    if (!stats_reset_pending()) {
+        entries = palloc(sizeof(MessageCount) * Max(global_variables->interval_slots,
+                                                    global_variables->window_slots));
+        /* short interval counters: last closed interval */
+        entries_scanned = put_values_to_tuple(get_interval_counters((current_interval_index - 1 + ring_intervals_count)
+                                                                    % ring_intervals_count),
+                                              1, filter, &names_cache, entries, tupdesc, tupstore);
+        /* long interval counters are summed up by the worker */
+        entries_scanned += put_values_to_tuple(window_counters, global_variables->intervals_count, filter,
+                                               &names_cache, entries, tupdesc, tupstore);
+        pfree(entries);
+    }
+    INSTR_TIME_SET_CURRENT(duration);
+    INSTR_TIME_SUBTRACT(duration, start_time);
+    pg_atomic_write_u64(&global_variables->internal_stats.scan_time_us, INSTR_TIME_GET_MICROSEC(duration));
+    pg_atomic_write_u64(&global_variables->internal_stats.scan_entries, entries_scanned);
+    return (Datum) 0;
+}
+
+Datum
+pg_log_errors_stats(PG_FUNCTION_ARGS)
+{
+    StatsFilter filter;
+    filter.db_oid = InvalidOid;
+    filter.user_oid = InvalidOid;
+    filter.message_type_index = -1;
+    filter.error_code = -1;
+    return log_errors_stats(fcinfo, &filter);
+}
+
+PG_FUNCTION_INFO_V1(pg_log_errors_stats_filtered);
+
+/* pg_log_errors_stats() of one database, user, type or sqlstate, NULL matches any */
+Datum
+pg_log_errors_stats_filtered(PG_FUNCTION_ARGS)
+{
+    StatsFilter filter;
+    char *str;
+    int i;
+
+    filter.db_oid = PG_ARGISNULL(0) ? InvalidOid : PG_GETARG_OID(0);
+    filter.user_oid = PG_ARGISNULL(1) ? InvalidOid : PG_GETARG_OID(1);
+    filter.message_type_index = -1;
+    if (!PG_ARGISNULL(2)) {
+        str = text_to_cstring(PG_GETARG_TEXT_PP(2));
+        for (i = 0; i < message_types_count; ++i) {
+            if (pg_strcasecmp(str, message_type_names[i]) == 0)
+                filter.message_type_index = i;
+        }
+        if (filter.message_type_index == -1)
+            ereport(ERROR,
+                    (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                            errmsg("unknown message type \"%s\"", str),
+                            errhint("Message type should be one of WARNING, ERROR, FATAL.")));
+    }
+    filter.error_code = -1;
+    if (!PG_ARGISNULL(3)) {
+        str = text_to_cstring(PG_GETARG_TEXT_PP(3));
+        if (!sqlstate_is_valid(str, false))
+            ereport(ERROR,
+                    (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                            errmsg("invalid sqlstate \"%s\"", str),
+                            errdetail("SQLSTATE code must be exactly %d digits or upper case letters.",
+                                      len_sqlstate_str)));
+        filter.error_code = MAKE_SQLSTATE(str[0], str[1], str[2], str[3], str[4]);
+    }
+    return log_errors_stats(fcinfo, &filter);
+}
+
+/*
+ * Compare the window maintained by the worker with the window counted up
+ * from intervals. Keys which went to overflow of the window are compared
+ * through overflow counters.
+ */
+static bool
+window_matches_intervals(int current_interval_index)
+{
+    HASHCTL ctl;
+    HTAB* counters_hashtable;
+    CounterHashElem* elem;
+    CounterEntry* entries;
+    HASH_SEQ_STATUS hash_seq;
+    uint32 overflow_count[message_types_count];
+    uint32 entries_count;
+    uint32 count;
+    uint32 j;
+    int k;
+    bool found;
+    bool result = true;
+
+    memset(&ctl, 0, sizeof(ctl));
+    ctl.keysize = sizeof(MessageKey);
+    ctl.entrysize = sizeof(CounterHashElem);
+#if PG_VERSION_NUM < 100000
+    counters_hashtable = hash_create("counters hashtable", 1, &ctl, HASH_ELEM);
+#else
+    counters_hashtable = hash_create("counters hashtable", 1, &ctl, HASH_ELEM | HASH_BLOBS);
+#endif
+    memset(overflow_count, 0, sizeof(overflow_count));
+    count_up_errors(global_variables->intervals_count, current_interval_index, counters_hashtable, overflow_count);
+
+    entries = interval_counters_entries(window_counters);
+    entries_count = pg_atomic_read_u32(&window_counters->entries_count);
+    pg_read_barrier();
+    for (j = 0; j < entries_count && result; ++j) {
+        count = pg_atomic_read_u32(&entries[j].counter);
+        elem = hash_search(counters_hashtable, (void *) &entries[j].key, HASH_FIND, &found);
+        if (!found)
+            result = (count == 0);
+        else {
+            result = ((uint32) elem->counter == count);
+            hash_search(counters_hashtable, (void *) &entries[j].key, HASH_REMOVE, &found);
+        }
+    }
+    /* What is left in hashtable must be in window overflow */
+    hash_seq_init(&hash_seq, counters_hashtable);
+    while ((elem = hash_seq_search(&hash_seq)) != NULL) {
+        overflow_count[message_key_type_index(elem->key)] += elem->counter;
+    }
+    for (k = 0; k < message_types_count; ++k) {
+        if (overflow_count[k] != pg_atomic_read_u32(&window_counters->overflow_count[k]))
+            result = false;
+    }
+    hash_destroy(counters_hashtable);
+    return result;
+}
+
+PG_FUNCTION_INFO_V1(pg_log_errors_verify_window);
+
+Datum
+pg_log_errors_verify_window(PG_FUNCTION_ARGS)
+{
+    uint64 current_interval_index;
+    uint32 change_count;
+    bool result = false;
+    int attempt;
+
+    if (global_variables == NULL) {
+        ereport(ERROR,
+                (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+                        errmsg("logerrors must be loaded via shared_preload_libraries")));
+    }
+    intervals_ring_attach(true);
+    /* Interval switch or reset in the middle of comparison makes it meaningless, try again */
+    for (attempt = 0; attempt < 3; ++attempt) {
+        change_count = pg_atomic_read_u32(&window_counters->change_count);
+        pg_read_barrier();
+        current_interval_index = pg_atomic_read_u64(&global_variables->messagesBuffer.current_interval_index);
+        result = window_matches_intervals(current_interval_index % ring_intervals_count);
+        pg_read_barrier();
+        if (change_count % 2 == 0 &&
+            change_count == pg_atomic_read_u32(&window_counters->change_count) &&
+            current_interval_index == pg_atomic_read_u64(&global_variables->messagesBuffer.current_interval_index))
+            break;
+    }
+    PG_RETURN_BOOL(result);
+}
+
+PG_FUNCTION_INFO_V1(pg_log_errors_reset);
+
+Datum
+pg_log_errors_reset(PG_FUNCTION_ARGS) {
+
+    if (global_variables == NULL) {
+        ereport(ERROR,
+                (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+                        errmsg("logerrors must be loaded via shared_preload_libraries")));
+    }
+
+    /* Backends restart their totals, the worker resets the rest on its next tick */
+    pg_atomic_fetch_add_u64(&global_variables->reset_epoch, 1);
+
+    PG_RETURN_VOID();
+}
+
+PG_FUNCTION_INFO_V1(pg_log_errors_advance_interval);
+
+/*
+ * Let the worker close count intervals now with logerrors.manual_clock and
+ * wait until it does, so tests and benchmarks don't sleep. Each interval
+ * ends logerrors.interval after the previous one by the clock of logerrors.
+ * Fails if the worker isn't running or closes no interval for
+ * advance_interval_timeout seconds. Only superusers may call it unless
+ * granted.
+ */
+Datum
+pg_log_errors_advance_interval(PG_FUNCTION_ARGS)
+{
+    int32 count = PG_GETARG_INT32(0);
+    uint64 requested_ticks;
+    uint64 done_ticks;
+    uint64 last_done_ticks;
+    TimestampTz last_progress;
+    Latch *worker_latch;
+
+    if (global_variables == NULL) {
+        ereport(ERROR,
+                (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+                        errmsg("logerrors must be loaded via shared_preload_libraries")));
+    }
+    if (!manual_clock)
+        ereport(ERROR,
+                (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+                        errmsg("logerrors intervals are advanced only with logerrors.manual_clock")));
+    if (count < 0)
+        ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                        errmsg("count of intervals must not be negative")));
+
+    requested_ticks = pg_atomic_add_fetch_u64(&global_variables->requested_ticks, count);
+    last_done_ticks = pg_atomic_read_u64(&global_variables->done_ticks);
+    last_progress = GetCurrentTimestamp();
+    while ((done_ticks = pg_atomic_read_u64(&global_variables->done_ticks)) < requested_ticks) {
+        if (done_ticks != last_done_ticks) {
+            last_done_ticks = done_ticks;
+            last_progress = GetCurrentTimestamp();
+        } else if (TimestampDifferenceExceeds(last_progress, GetCurrentTimestamp(),
+                                              advance_interval_timeout * 1000)) {
+            /* The worker closes the requested intervals once it is back */
+            if (global_variables->worker_latch == NULL)
+                ereport(ERROR,
+                        (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+                                errmsg("logerrors worker is not running")));
+            ereport(ERROR,
+                    (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+                            errmsg("logerrors worker has not closed an interval for %d seconds",
+                                   advance_interval_timeout)));
+        }
+        worker_latch = global_variables->worker_latch;
+        if (worker_latch != NULL)
+            SetLatch(worker_latch);
+        pg_usleep(1000L);
+        CHECK_FOR_INTERRUPTS();
+    }
+
+    PG_RETURN_VOID();
+}
+
+PG_FUNCTION_INFO_V1(pg_slow_log_stats);
+
+Datum
+pg_slow_log_stats(PG_FUNCTION_ARGS)
+{
+#define SLOW_LOG_COLS 2
+    ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+    Tuplestorestate *tupstore;
+    TupleDesc tupdesc;
+    MemoryContext per_query_ctx;
+    MemoryContext oldcontext;
+    int i;
+
+    Datum result_values[SLOW_LOG_COLS];
+    bool result_nulls[SLOW_LOG_COLS];
+
+    /* Shmem structs not ready yet */
+    if (global_variables == NULL) {
+         ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("logerrors must be loaded via shared_preload_libraries")));
+    }
+    /* check to see if caller supports us returning a tuplestore */
+    if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+        ereport(ERROR,
+                (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+                        errmsg("set-valued function called in context that cannot accept a set")));
+    if (!(rsinfo->allowedModes & SFRM_Materialize))
+        ereport(ERROR,
+                (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+                        errmsg("materialize mode required, but it is not allowed in this context")));
+
+    /* Build a tuple descriptor for our result type */
+    if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+        ereport(ERROR,
+                (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+                        errmsg("return type must be a row type")));
+
+    per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+    oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+    tupstore = tuplestore_begin_heap(true, false, work_mem);
+    rsinfo->returnMode = SFRM_Materialize;
+    rsinfo->setResult = tupstore;
+    rsinfo->setDesc = tupdesc;
+    MemoryContextSwitchTo(oldcontext);
+
+    MemSet(result_values, 0, sizeof(result_values));
+    MemSet(result_nulls, 0, sizeof(result_nulls));
+    for (i = 0; i < SLOW_LOG_COLS; i++) {
+        result_nulls[i] = false;
+    }
+    /* Until the worker applies reset there is nothing counted since it */
+    if (stats_reset_pending())
+        result_values[0] = Int32GetDatum(0);
+    else
+        result_values[0] = DatumGetInt32(pg_atomic_read_u32(&global_variables->slow_log_info.count));
+    result_values[1] = DatumGetTimestamp(pg_atomic_read_u64(&global_variables->slow_log_info.reset_time));
+
+    tuplestore_putvalues(tupstore, tupdesc, result_values, result_nulls);
+    return (Datum) 0;
+}
+
+/* Set username and database columns, histogram of the rest has neither */
+static void
+put_histogram_names(SlowLogHistogram *histogram, Datum *values, bool *nulls)
+{
+    char *user_name = NULL;
+    char *db_name = NULL;
+    if (OidIsValid(histogram->user_oid))
+        user_name = get_user_by_oid(histogram->user_oid);
+    if (user_name == NULL)
+        nulls[0] = true;
+    else
+        values[0] = CStringGetTextDatum(user_name);
+    if (OidIsValid(histogram->db_oid))
+        db_name = get_database_name(histogram->db_oid);
+    if (db_name == NULL)
+        nulls[1] = true;
+    else
+        values[1] = CStringGetTextDatum(db_name);
+}
+
+/* Copy of histogram buckets, returns count of durations in it */
+static uint64
+read_histogram(SlowLogHistogram *histogram, uint64 *buckets)
+{
+    uint64 total = 0;
+    int i;
+    for (i = 0; i < slow_log_buckets_count; ++i) {
+        buckets[i] = pg_atomic_read_u32(&histogram->buckets[i]);
+        total += buckets[i];
+    }
+    return total;
+}
+
+/* Upper bound of bucket where percent of durations is reached, in ms */
+static double
+histogram_percentile(const uint64 *buckets, uint64 total, int percent)
+{
+    uint64 rank = (total * percent + 99) / 100;
+    uint64 seen = 0;
+    int i;
+    for (i = 0; i < slow_log_buckets_count - 1; ++i) {
+        seen += buckets[i];
+        if (seen >= rank)
+            break;
+    }
+    return (double) slow_log_bucket_upper(i) / 1000.0;
+}
+
+PG_FUNCTION_INFO_V1(pg_slow_log_histogram);
+
+Datum
+pg_slow_log_histogram(PG_FUNCTION_ARGS)
+{
+#define SLOW_LOG_HISTOGRAM_COLS 5
+    Tuplestorestate *tupstore;
+    TupleDesc tupdesc;
+    Datum result_values[SLOW_LOG_HISTOGRAM_COLS];
+    bool result_nulls[SLOW_LOG_HISTOGRAM_COLS];
+    uint64 buckets[slow_log_buckets_count];
+    uint32 used_count;
+    uint32 i;
+    int j;
+
+    tupstore = begin_result_tuplestore(fcinfo, &tupdesc);
+    if (stats_reset_pending())
+        return (Datum) 0;
+    used_count = pg_atomic_read_u32(&slow_log_histograms->used_count);
+    pg_read_barrier();
+    /* Histogram of the rest goes last */
+    for (i = 0; i <= used_count; ++i) {
+        SlowLogHistogram *histogram = &slow_log_histograms->histograms[i == used_count ? slow_log_histograms_count : i];
+        if (read_histogram(histogram, buckets) == 0)
+            continue;
+        for (j = 0; j < slow_log_buckets_count; ++j) {
+            if (buckets[j] == 0)
+                continue;
+            MemSet(result_values, 0, sizeof(result_values));
+            MemSet(result_nulls, 0, sizeof(result_nulls));
+            put_histogram_names(histogram, result_values, result_nulls);
+            result_values[2] = Float8GetDatum((double) slow_log_bucket_lower(j) / 1000.0);
+            result_values[3] = Float8GetDatum((double) slow_log_bucket_upper(j) / 1000.0);
+            result_values[4] = Int64GetDatum((int64) buckets[j]);
+            tuplestore_putvalues(tupstore, tupdesc, result_values, result_nulls);
+        }
+    }
+    return (Datum) 0;
+}
+
+PG_FUNCTION_INFO_V1(pg_slow_log_percentiles);
 
-        ResetLatch(&MyProc->procLatch);
-        /* Emergency bailout if postmaster has died */
-        if (rc & WL_POSTMASTER_DEATH)
-            proc_exit(1);
-        /* Process signals */
+Datum
+pg_slow_log_percentiles(PG_FUNCTION_ARGS)
+{
+#define SLOW_LOG_PERCENTILES_COLS 6
+    Tuplestorestate *tupstore;
+    TupleDesc tupdesc;
+    Datum result_values[SLOW_LOG_PERCENTILES_COLS];
+    bool result_nulls[SLOW_LOG_PERCENTILES_COLS];
+    uint64 buckets[slow_log_buckets_count];
+    uint64 total;
+    uint32 used_count;
+    uint32 i;
 
-        if (got_sigterm)
-        {
-            /* Simply exit */
-            elog(DEBUG1, "bgworker logerrors signal: processed SIGTERM");
-            proc_exit(0);
+    tupstore = begin_result_tuplestore(fcinfo, &tupdesc);
+    if (stats_reset_pending())
+        return (Datum) 0;
+    used_count = pg_atomic_read_u32(&slow_log_histograms->used_count);
+    pg_read_barrier();
+    /* Histogram of the rest goes last */
+    for (i = 0; i <= used_count; ++i) {
+        SlowLogHistogram *histogram = &slow_log_histograms->histograms[i == used_count ? slow_log_histograms_count : i];
+        total = read_histogram(histogram, buckets);
+        if (total == 0)
+            continue;
+        MemSet(result_values, 0, sizeof(result_values));
+        MemSet(result_nulls, 0, sizeof(result_nulls));
+        put_histogram_names(histogram, result_values, result_nulls);
+        result_values[2] = Int64GetDatum((int64) total);
+        result_values[3] = Float8GetDatum(histogram_percentile(buckets, total, 50));
+        result_values[4] = Float8GetDatum(histogram_percentile(buckets, total, 95));
+        result_values[5] = Float8GetDatum(histogram_percentile(buckets, total, 99));
+        tuplestore_putvalues(tupstore, tupdesc, result_values, result_nulls);
+    }
+    return (Datum) 0;
+}
+
+/*
+ * Tier to read history since the given time from: -1 for intervals if they
+ * reach back that far, otherwise the first tier which does, or the last one.
+ * So a long range costs no more than buckets of a coarser tier.
+ */
+static int
+history_tier(TimestampTz since)
+{
+    TimestampTz now = logerrors_now();
+    RollupTier *tier;
+    int last_tier = -1;
+    int i;
+    if (since >= now - (TimestampTz) global_variables->intervals_count * global_variables->interval * 1000)
+        return -1;
+    for (i = 0; i < rollup_tiers_count; ++i) {
+        tier = get_rollup_tier(i);
+        if (tier->buckets_count == 0)
+            continue;
+        last_tier = i;
+        if (since >= now - tier->buckets_count * rollup_tier_periods[i])
+            return i;
+    }
+    return last_tier;
+}
+
+PG_FUNCTION_INFO_V1(pg_log_errors_history);
+
+/*
+ * Counts of closed intervals which ended after since, oldest first. If
+ * intervals don't reach since, buckets of a rollup tier are returned.
+ */
+Datum
+pg_log_errors_history(PG_FUNCTION_ARGS)
+{
+#define HISTORY_COLS 9
+    TimestampTz since = PG_GETARG_TIMESTAMPTZ(0);
+    Tuplestorestate *tupstore;
+    TupleDesc tupdesc;
+    Datum result_values[HISTORY_COLS];
+    bool result_nulls[HISTORY_COLS];
+    MessageCount *entries;
+    uint32 entries_count;
+    uint32 overflow_count[message_types_count];
+    TimestampTz start_time;
+    TimestampTz end_time;
+    uint64 sequence;
+    int tier_index;
+    int buckets_count;
+    int current_bucket;
+    int last_bucket;
+    int i;
+    uint32 j;
+    NamesCache names_cache;
+    NameCacheEntry *name;
+
+    tupstore = begin_result_tuplestore(fcinfo, &tupdesc);
+    /* Until the worker applies reset there is nothing counted since it */
+    if (stats_reset_pending())
+        return (Datum) 0;
+    names_cache_init(&names_cache);
+    entries = palloc(sizeof(MessageCount) * Max(global_variables->interval_slots, tier_slots));
+    tier_index = history_tier(since);
+    if (tier_index < 0) {
+        buckets_count = ring_intervals_count;
+        current_bucket = pg_atomic_read_u64(&global_variables->messagesBuffer.current_interval_index) %
+                (uint64)buckets_count;
+        /* The current interval is open */
+        last_bucket = buckets_count - 1;
+    } else {
+        buckets_count = get_rollup_tier(tier_index)->buckets_count;
+        current_bucket = pg_atomic_read_u64(&get_rollup_tier(tier_index)->current_bucket) % (uint64)buckets_count;
+        last_bucket = buckets_count;
+    }
+    for (i = 1; i <= last_bucket; ++i) {
+        if (!copy_closed_interval(tier_index < 0 ? get_interval_counters((current_bucket + i) % buckets_count)
+                                                 : get_tier_bucket(tier_index, (current_bucket + i) % buckets_count),
+                                  &start_time, &end_time, &sequence,
+                                  entries, &entries_count, overflow_count))
+            continue;
+        if (end_time <= since)
+            continue;
+        MemSet(result_values, 0, sizeof(result_values));
+        result_values[0] = TimestampTzGetDatum(start_time);
+        result_values[1] = TimestampTzGetDatum(end_time);
+        for (j = 0; j < entries_count; ++j) {
+            if (entries[j].count == 0)
+                continue;
+            MemSet(result_nulls, 0, sizeof(result_nulls));
+            result_values[2] = CStringGetTextDatum(message_type_names[entries[j].key.message_type_index]);
+            name = get_error_name_cached(&names_cache, entries[j].key.error_code);
+            result_values[3] = name->name;
+            result_values[4] = name->sqlstate;
+            name = get_database_name_cached(&names_cache, entries[j].key.db_oid);
+            result_values[5] = name->name;
+            result_nulls[5] = name->isnull;
+            name = get_user_name_cached(&names_cache, entries[j].key.user_oid);
+            result_values[6] = name->name;
+            result_nulls[6] = name->isnull;
+            result_values[7] = Int64GetDatum((int64) entries[j].count);
+            result_values[8] = BoolGetDatum(entries[j].estimated > 0);
+            tuplestore_putvalues(tupstore, tupdesc, result_values, result_nulls);
+        }
+        /* Messages which didn't fit into interval slots, counted only by type */
+        for (j = 0; j < message_types_count; ++j) {
+            if (overflow_count[j] == 0)
+                continue;
+            MemSet(result_nulls, 0, sizeof(result_nulls));
+            result_values[2] = CStringGetTextDatum(message_type_names[j]);
+            result_values[3] = CStringGetTextDatum("OVERFLOW");
+            result_nulls[4] = true;
+            result_nulls[5] = true;
+            result_nulls[6] = true;
+            result_values[7] = Int64GetDatum((int64) overflow_count[j]);
+            result_nulls[8] = true;
+            tuplestore_putvalues(tupstore, tupdesc, result_values, result_nulls);
         }
-        /* Main work happens here */
-        logerrors_update_info();
     }
+    pfree(entries);
+    return (Datum) 0;
+}
 
-    /* No problems, so clean exit */
-    proc_exit(0);
+static int
+heavy_hitter_count_cmp(const void *a, const void *b)
+{
+    uint64 count_a = ((const HeavyHitter *) a)->count;
+    uint64 count_b = ((const HeavyHitter *) b)->count;
+    if (count_a == count_b)
+        return 0;
+    return count_a > count_b ? -1 : 1;
 }
 
-/* Log hook */
-void
-logerrors_emit_log_hook(ErrorData *edata)
+PG_FUNCTION_INFO_V1(pg_log_errors_top);
+
+/* Most frequent message fingerprints since reset */
+Datum
+pg_log_errors_top(PG_FUNCTION_ARGS)
 {
-    int lvl_i;
-    int err_code_index;
-    bool skip;
-    /* Only if hashtable already inited */
-    if (global_variables != NULL && MyProc != NULL && !proc_exit_inprogress && !got_sigterm) {
-        for (lvl_i = 0; lvl_i < message_types_count; ++lvl_i)
-        {
-            /* Only current message type */
-            if (edata->elevel != message_types_codes[lvl_i])
+#define TOP_COLS 7
+    int32 limit = PG_GETARG_INT32(0);
+    Tuplestorestate *tupstore;
+    TupleDesc tupdesc;
+    Datum result_values[TOP_COLS];
+    bool result_nulls[TOP_COLS];
+    HeavyHitters *hitters_copy;
+    HeavyHitter *entry;
+    int i;
+
+    tupstore = begin_result_tuplestore(fcinfo, &tupdesc);
+    if (stats_reset_pending())
+        return (Datum) 0;
+    hitters_copy = palloc(sizeof(HeavyHitters));
+    SpinLockAcquire(&heavy_hitters->mutex);
+    memcpy(hitters_copy, heavy_hitters, sizeof(HeavyHitters));
+    SpinLockRelease(&heavy_hitters->mutex);
+
+    qsort(hitters_copy->entries, hitters_copy->used_count, sizeof(HeavyHitter), heavy_hitter_count_cmp);
+    for (i = 0; i < hitters_copy->used_count && i < limit; ++i) {
+        entry = &hitters_copy->entries[i];
+        MemSet(result_values, 0, sizeof(result_values));
+        MemSet(result_nulls, 0, sizeof(result_nulls));
+        result_values[0] = Int64GetDatum((int64) entry->fingerprint);
+        result_values[1] = CStringGetTextDatum(message_type_names[entry->message_type_index]);
+        result_values[2] = CStringGetTextDatum(get_error_name(entry->error_code));
+        result_values[3] = CStringGetTextDatum(unpack_sql_state(entry->error_code));
+        result_values[4] = Int64GetDatum((int64) entry->count);
+        result_values[5] = Int64GetDatum((int64) entry->error);
+        result_values[6] = CStringGetTextDatum(entry->sample);
+        tuplestore_putvalues(tupstore, tupdesc, result_values, result_nulls);
+    }
+    /* Messages which didn't get a fingerprint slot in their backend, counted only by type */
+    for (i = 0; i < message_types_count; ++i) {
+        if (hitters_copy->dropped_count[i] == 0)
+            continue;
+        MemSet(result_values, 0, sizeof(result_values));
+        MemSet(result_nulls, 0, sizeof(result_nulls));
+        result_nulls[0] = true;
+        result_values[1] = CStringGetTextDatum(message_type_names[i]);
+        result_values[2] = CStringGetTextDatum("OVERFLOW");
+        result_nulls[3] = true;
+        result_values[4] = Int64GetDatum((int64) hitters_copy->dropped_count[i]);
+        result_values[5] = Int64GetDatum(0);
+        result_nulls[6] = true;
+        tuplestore_putvalues(tupstore, tupdesc, result_values, result_nulls);
+    }
+    pfree(hitters_copy);
+    return (Datum) 0;
+}
+
+PG_FUNCTION_INFO_V1(pg_log_errors_counters);
+
+/* Cumulative counters since reset, see CumulativeCounters */
+Datum
+pg_log_errors_counters(PG_FUNCTION_ARGS)
+{
+#define COUNTERS_COLS 8
+    static const char *const rest_names[2] = {"EVICTED", "OVERFLOW"};
+    Tuplestorestate *tupstore;
+    TupleDesc tupdesc;
+    Datum result_values[COUNTERS_COLS];
+    bool result_nulls[COUNTERS_COLS];
+    CumulativeCounters *cumulative_copy;
+    CumulativeCounter *entry;
+    NamesCache names_cache;
+    NameCacheEntry *name;
+    uint64 rest_counts[2];
+    int i;
+    int j;
+
+    tupstore = begin_result_tuplestore(fcinfo, &tupdesc);
+    if (stats_reset_pending())
+        return (Datum) 0;
+    cumulative_copy = palloc(sizeof(CumulativeCounters));
+    SpinLockAcquire(&cumulative_counters->mutex);
+    memcpy(cumulative_copy, cumulative_counters, sizeof(CumulativeCounters));
+    SpinLockRelease(&cumulative_counters->mutex);
+
+    names_cache_init(&names_cache);
+    for (i = 0; i < cumulative_copy->used_count; ++i) {
+        entry = &cumulative_copy->entries[i];
+        MemSet(result_values, 0, sizeof(result_values));
+        MemSet(result_nulls, 0, sizeof(result_nulls));
+        result_values[0] = CStringGetTextDatum(message_type_names[entry->key.message_type_index]);
+        name = get_error_name_cached(&names_cache, entry->key.error_code);
+        result_values[1] = name->name;
+        result_values[2] = name->sqlstate;
+        result_values[3] = ObjectIdGetDatum(entry->key.db_oid);
+        result_values[4] = ObjectIdGetDatum(entry->key.user_oid);
+        name = get_database_name_cached(&names_cache, entry->key.db_oid);
+        result_values[5] = name->name;
+        result_nulls[5] = name->isnull;
+        name = get_user_name_cached(&names_cache, entry->key.user_oid);
+        result_values[6] = name->name;
+        result_nulls[6] = name->isnull;
+        result_values[7] = Int64GetDatum((int64) entry->count);
+        tuplestore_putvalues(tupstore, tupdesc, result_values, result_nulls);
+    }
+    /* Messages of evicted entries and of the ones which never got an entry, counted only by type */
+    for (i = 0; i < message_types_count; ++i) {
+        rest_counts[0] = cumulative_copy->evicted_count[i];
+        rest_counts[1] = cumulative_copy->overflow_count[i];
+        for (j = 0; j < 2; ++j) {
+            if (rest_counts[j] == 0)
                 continue;
-            skip = false;
-            for (err_code_index = 0; err_code_index < global_variables->excluded_errcodes_count; ++err_code_index) {
-                if (edata->sqlerrcode == global_variables->excluded_errcodes[err_code_index]) {
-                    skip = true;
-                    break;
+            MemSet(result_values, 0, sizeof(result_values));
+            MemSet(result_nulls, true, sizeof(result_nulls));
+            result_values[0] = CStringGetTextDatum(message_type_names[i]);
+            result_nulls[0] = false;
+            result_values[1] = CStringGetTextDatum(rest_names[j]);
+            result_nulls[1] = false;
+            result_values[7] = Int64GetDatum((int64) rest_counts[j]);
+            result_nulls[7] = false;
+            tuplestore_putvalues(tupstore, tupdesc, result_values, result_nulls);
+        }
+    }
+    pfree(cumulative_copy);
+    return (Datum) 0;
+}
+
+PG_FUNCTION_INFO_V1(pg_log_errors_classes);
+
+/*
+ * Counts of messages per class of code (first two characters of SQLSTATE)
+ * in the last interval, in the long window and since reset (time_interval
+ * is NULL), see ClassCounters. Classes which are not in errcodes.txt are
+ * counted together as OTHER.
+ */
+Datum
+pg_log_errors_classes(PG_FUNCTION_ARGS)
+{
+#define CLASSES_COLS 5
+    Tuplestorestate *tupstore;
+    TupleDesc tupdesc;
+    Datum result_values[CLASSES_COLS];
+    bool result_nulls[CLASSES_COLS];
+    uint64 (*counts)[message_types_count][error_class_slots];
+    int32 time_intervals[3];
+    const char *name;
+    char class_name[3];
+    int i;
+    int j;
+    int k;
+
+    tupstore = begin_result_tuplestore(fcinfo, &tupdesc);
+    counts = palloc(sizeof(uint64) * 3 * message_types_count * error_class_slots);
+    time_intervals[0] = global_variables->interval / 1000;
+    time_intervals[1] = global_variables->interval * global_variables->intervals_count / 1000;
+    /* Until the worker applies reset there is nothing counted since it */
+    if (stats_reset_pending()) {
+        memset(counts, 0, sizeof(uint64) * 3 * message_types_count * error_class_slots);
+    } else {
+        SpinLockAcquire(&class_counters->mutex);
+        memcpy(counts[0], class_counters->interval_count, sizeof(class_counters->interval_count));
+        memcpy(counts[1], class_counters->window_count, sizeof(class_counters->window_count));
+        memcpy(counts[2], class_counters->total_count, sizeof(class_counters->total_count));
+        SpinLockRelease(&class_counters->mutex);
+    }
+
+    for (i = 0; i < 3; ++i) {
+        for (j = 0; j < message_types_count; ++j) {
+            for (k = 0; k < error_class_slots; ++k) {
+                if (counts[i][j][k] == 0)
+                    continue;
+                MemSet(result_values, 0, sizeof(result_values));
+                MemSet(result_nulls, 0, sizeof(result_nulls));
+                result_values[0] = Int32GetDatum(time_intervals[i]);
+                result_nulls[0] = (i == 2);
+                result_values[1] = CStringGetTextDatum(message_type_names[j]);
+                if (k == error_classes_count) {
+                    result_nulls[2] = true;
+                    result_values[3] = CStringGetTextDatum("OTHER");
+                } else {
+                    memcpy(class_name, unpack_sql_state(error_classes[k]), 2);
+                    class_name[2] = '\0';
+                    result_values[2] = CStringGetTextDatum(class_name);
+                    /* Code of the class itself, like 08000 */
+                    name = get_error_name(error_classes[k]);
+                    if (strcmp(name, "NOT_KNOWN_ERROR") == 0)
+                        result_nulls[3] = true;
+                    else
+                        result_values[3] = CStringGetTextDatum(name);
                 }
+                result_values[4] = Int64GetDatum((int64) counts[i][j][k]);
+                tuplestore_putvalues(tupstore, tupdesc, result_values, result_nulls);
             }
-            if (skip)
+        }
+    }
+    pfree(counts);
+    return (Datum) 0;
+}
+
+PG_FUNCTION_INFO_V1(pg_log_errors_changes);
+
+/*
+ * Counts of intervals closed after the one with sequence since, oldest
+ * first. Every row has sequence of the last closed interval as high_water
+ * and the oldest interval kept after since as first_sequence, if nothing has
+ * changed the only row has nothing else.
+ */
+Datum
+pg_log_errors_changes(PG_FUNCTION_ARGS)
+{
+#define CHANGES_COLS 12
+    int64 since = PG_GETARG_INT64(0);
+    Tuplestorestate *tupstore;
+    TupleDesc tupdesc;
+    Datum result_values[CHANGES_COLS];
+    bool result_nulls[CHANGES_COLS];
+    MessageCount *entries;
+    uint32 entries_count;
+    uint32 overflow_count[message_types_count];
+    TimestampTz start_time;
+    TimestampTz end_time;
+    uint64 sequence;
+    uint64 high_water;
+    uint64 first_sequence;
+    int current_interval;
+    int new_intervals;
+    bool found = false;
+    int i;
+    uint32 j;
+    NamesCache names_cache;
+    NameCacheEntry *name;
+
+    tupstore = begin_result_tuplestore(fcinfo, &tupdesc);
+    high_water = pg_atomic_read_u64(&global_variables->messagesBuffer.last_sequence);
+    pg_read_barrier();
+    current_interval = pg_atomic_read_u64(&global_variables->messagesBuffer.current_interval_index) %
+            (uint64)ring_intervals_count;
+    /*
+     * Walk back only over the new intervals, so the call costs as much as the
+     * new data. The oldest of them is the first sequence kept after since,
+     * the intervals before it were overwritten or reset.
+     */
+    first_sequence = high_water + 1;
+    for (new_intervals = 0; new_intervals < ring_intervals_count - 1 && !stats_reset_pending(); ++new_intervals) {
+        sequence = pg_atomic_read_u64(&get_interval_counters(
+                (current_interval - new_intervals - 1 + ring_intervals_count)
+                % ring_intervals_count)->sequence);
+        if (sequence == 0 || (int64) sequence <= since)
+            break;
+        first_sequence = sequence;
+    }
+
+    names_cache_init(&names_cache);
+    entries = palloc(sizeof(MessageCount) * global_variables->interval_slots);
+    MemSet(result_values, 0, sizeof(result_values));
+    result_values[9] = Int64GetDatum((int64) high_water);
+    result_values[11] = Int64GetDatum((int64) first_sequence);
+    for (i = new_intervals; i > 0; --i) {
+        if (!copy_closed_interval(get_interval_counters((current_interval - i + ring_intervals_count)
+                                                        % ring_intervals_count),
+                                  &start_time, &end_time, &sequence, entries, &entries_count, overflow_count))
+            continue;
+        /* Closed or overwritten after the walk */
+        if ((int64) sequence <= since || sequence > high_water)
+            continue;
+        result_values[0] = Int64GetDatum((int64) sequence);
+        result_values[1] = TimestampTzGetDatum(start_time);
+        result_values[2] = TimestampTzGetDatum(end_time);
+        for (j = 0; j < entries_count; ++j) {
+            if (entries[j].count == 0)
                 continue;
-            add_message(edata->sqlerrcode, MyDatabaseId, GetUserId(), lvl_i);
-            pg_atomic_fetch_add_u32(&global_variables->total_count[lvl_i], 1);
+            MemSet(result_nulls, 0, sizeof(result_nulls));
+            result_values[3] = CStringGetTextDatum(message_type_names[entries[j].key.message_type_index]);
+            name = get_error_name_cached(&names_cache, entries[j].key.error_code);
+            result_values[4] = name->name;
+            result_values[5] = name->sqlstate;
+            name = get_database_name_cached(&names_cache, entries[j].key.db_oid);
+            result_values[6] = name->name;
+            result_nulls[6] = name->isnull;
+            name = get_user_name_cached(&names_cache, entries[j].key.user_oid);
+            result_values[7] = name->name;
+            result_nulls[7] = name->isnull;
+            result_values[8] = Int64GetDatum((int64) entries[j].count);
+            result_values[10] = BoolGetDatum(entries[j].estimated > 0);
+            tuplestore_putvalues(tupstore, tupdesc, result_values, result_nulls);
+            found = true;
         }
-        if (edata && edata->message && strstr(edata->message, "duration:"))
-        {
-            pg_atomic_fetch_add_u32(&global_variables->slow_log_info.count, 1);
+        /* Messages which didn't fit into interval slots, counted only by type */
+        for (j = 0; j < message_types_count; ++j) {
+            if (overflow_count[j] == 0)
+                continue;
+            MemSet(result_nulls, 0, sizeof(result_nulls));
+            result_values[3] = CStringGetTextDatum(message_type_names[j]);
+            result_values[4] = CStringGetTextDatum("OVERFLOW");
+            result_nulls[5] = true;
+            result_nulls[6] = true;
+            result_nulls[7] = true;
+            result_values[8] = Int64GetDatum((int64) overflow_count[j]);
+            result_nulls[10] = true;
+            tuplestore_putvalues(tupstore, tupdesc, result_values, result_nulls);
+            found = true;
         }
     }
+    if (!found) {
+        MemSet(result_nulls, true, sizeof(result_nulls));
+        result_nulls[9] = false;
+        result_nulls[11] = false;
+        tuplestore_putvalues(tupstore, tupdesc, result_values, result_nulls);
+    }
+    pfree(entries);
+    return (Datum) 0;
+}
 
-    if (prev_emit_log_hook) {
-        prev_emit_log_hook(edata);
+PG_FUNCTION_INFO_V1(pg_log_errors_internal_stats);
+
+/*
+ * Cost of logerrors itself: calls of the hook and their time summed over
+ * backends, ticks of the worker and the last scan by pg_log_errors_stats().
+ * Messages which lost their kind to overflow or eviction are counted since
+ * reset, the rest since start.
+ */
+Datum
+pg_log_errors_internal_stats(PG_FUNCTION_ARGS)
+{
+#define INTERNAL_STATS_COLS 14
+    Tuplestorestate *tupstore;
+    TupleDesc tupdesc;
+    Datum result_values[INTERNAL_STATS_COLS];
+    bool result_nulls[INTERNAL_STATS_COLS];
+    InternalStats *stats;
+    BackendCounters *counters;
+    uint64 hook_calls = 0;
+    uint64 filtered_count = 0;
+    uint64 sampled_out_count = 0;
+    uint64 timed_calls = 0;
+    uint64 hook_time_ns = 0;
+    uint64 hook_time_max_ns = 0;
+    uint64 overflow_count = 0;
+    uint64 evicted_count = 0;
+    int i;
+
+    tupstore = begin_result_tuplestore(fcinfo, &tupdesc);
+    for (i = 0; i <= global_variables->backends_count; ++i) {
+        counters = get_backend_counters(i);
+        hook_calls += pg_atomic_read_u64(&counters->hook_calls);
+        filtered_count += pg_atomic_read_u64(&counters->filtered_count);
+        sampled_out_count += pg_atomic_read_u64(&counters->sampled_out_count);
+        timed_calls += pg_atomic_read_u64(&counters->timed_calls);
+        hook_time_ns += pg_atomic_read_u64(&counters->hook_time_ns);
+        hook_time_max_ns = Max(hook_time_max_ns, pg_atomic_read_u64(&counters->hook_time_max_ns));
+    }
+    /* They are zero since reset, even if the worker didn't apply it yet */
+    if (!stats_reset_pending()) {
+        SpinLockAcquire(&cumulative_counters->mutex);
+        for (i = 0; i < message_types_count; ++i) {
+            overflow_count += cumulative_counters->overflow_count[i];
+            evicted_count += cumulative_counters->evicted_count[i];
+        }
+        SpinLockRelease(&cumulative_counters->mutex);
     }
+    stats = &global_variables->internal_stats;
+
+    MemSet(result_nulls, 0, sizeof(result_nulls));
+    result_values[0] = Int64GetDatum((int64) hook_calls);
+    result_values[1] = Int64GetDatum((int64) filtered_count);
+    result_values[2] = Int64GetDatum((int64) sampled_out_count);
+    result_values[3] = Int64GetDatum((int64) overflow_count);
+    result_values[4] = Int64GetDatum((int64) evicted_count);
+    result_values[5] = Int64GetDatum((int64) timed_calls);
+    /* Time of the timed calls scaled up to all of them */
+    if (timed_calls > 0)
+        result_values[6] = Float8GetDatum((double) hook_time_ns / timed_calls * hook_calls / 1000000.0);
+    else
+        result_nulls[6] = true;
+    result_values[7] = Float8GetDatum(hook_time_max_ns / 1000.0);
+    result_values[8] = Int64GetDatum((int64) pg_atomic_read_u64(&stats->ticks_count));
+    result_values[9] = Float8GetDatum(pg_atomic_read_u64(&stats->tick_lag_us) / 1000.0);
+    result_values[10] = Float8GetDatum(pg_atomic_read_u64(&stats->tick_lag_max_us) / 1000.0);
+    result_values[11] = Float8GetDatum(pg_atomic_read_u64(&stats->tick_time_us) / 1000.0);
+    result_values[12] = Float8GetDatum(pg_atomic_read_u64(&stats->scan_time_us) / 1000.0);
+    result_values[13] = Int64GetDatum((int64) pg_atomic_read_u64(&stats->scan_entries));
+    tuplestore_putvalues(tupstore, tupdesc, result_values, result_nulls);
+    return (Datum) 0;
 }
 
-static void
-logerrors_load_params(void)
+PG_FUNCTION_INFO_V1(pg_log_errors_alerts);
+
+/* Alerts fired by logerrors.alert_rules since reset, the oldest first, see alerts_add_interval() */
+Datum
+pg_log_errors_alerts(PG_FUNCTION_ARGS)
 {
-    DefineCustomIntVariable("logerrors.interval",
-                            "Time between writing stat to buffer (ms).",
-                            "Default of 5s, max of 60s",
-                            &interval,
-                            5000,
-                            1000,
-                            60000,
-                            PGC_SUSET,
-                            GUC_UNIT_MS | GUC_NO_RESET_ALL,
-                            NULL,
-                            NULL,
-                            NULL);
-    DefineCustomIntVariable("logerrors.intervals_count",
-                            "Count of intervals in buffer",
-                            "Default of 120, max of 360",
-                            &intervals_count,
-                            120,
-                            2,
-                            max_intervals_count,
-                            PGC_SUSET,
-                            GUC_NO_RESET_ALL,
-                            NULL,
-                            NULL,
-                            NULL);
-    DefineCustomStringVariable("logerrors.excluded_errcodes",
-                               "Excluded error codes separated by ','",
-                               NULL,
-                               &excluded_errcodes_str,
-                               NULL,
-                               PGC_POSTMASTER,
-                               GUC_NO_RESET_ALL,
-                               NULL,
-                               NULL,
-                               NULL);
+#define ALERTS_COLS 9
+    Tuplestorestate *tupstore;
+    TupleDesc tupdesc;
+    Datum result_values[ALERTS_COLS];
+    bool result_nulls[ALERTS_COLS];
+    AlertEvents *events_copy;
+    AlertEvent *event;
+    NamesCache names_cache;
+    NameCacheEntry *name;
+    uint64 first;
+    uint64 i;
+
+    tupstore = begin_result_tuplestore(fcinfo, &tupdesc);
+    if (stats_reset_pending())
+        return (Datum) 0;
+    events_copy = palloc(sizeof(AlertEvents));
+    SpinLockAcquire(&alert_events->mutex);
+    memcpy(events_copy, alert_events, sizeof(AlertEvents));
+    SpinLockRelease(&alert_events->mutex);
+
+    names_cache_init(&names_cache);
+    first = events_copy->fired_count > alert_events_count ? events_copy->fired_count - alert_events_count : 0;
+    for (i = first; i < events_copy->fired_count; ++i) {
+        event = &events_copy->events[i % alert_events_count];
+        MemSet(result_values, 0, sizeof(result_values));
+        MemSet(result_nulls, 0, sizeof(result_nulls));
+        result_values[0] = TimestampTzGetDatum(event->fired_at);
+        result_values[1] = CStringGetTextDatum(event->rule);
+        result_values[2] = CStringGetTextDatum(message_type_names[event->message_type_index]);
+        if (event->error_code == alert_overflow_code) {
+            result_values[3] = CStringGetTextDatum("OVERFLOW");
+            result_nulls[4] = true;
+        } else {
+            name = get_error_name_cached(&names_cache, event->error_code);
+            result_values[3] = name->name;
+            result_values[4] = name->sqlstate;
+        }
+        result_values[5] = Int64GetDatum((int64) event->count);
+        result_values[6] = Float8GetDatum(event->threshold);
+        result_values[7] = Float8GetDatum(event->mean);
+        result_values[8] = Float8GetDatum(event->stddev);
+        tuplestore_putvalues(tupstore, tupdesc, result_values, result_nulls);
+    }
+    pfree(events_copy);
+    return (Datum) 0;
 }
+
+/* Fields of a log record which backfill needs, longer values are cut */
+typedef struct log_record {
+    char time[64];
+    int time_len;
+    char user_name[NAMEDATALEN];
+    int user_name_len;
+    char db_name[NAMEDATALEN];
+    int db_name_len;
+    char severity[16];
+    int severity_len;
+    char sqlstate[len_sqlstate_str + 1];
+    int sqlstate_len;
+} LogRecord;
+
+/* States of jsonlog parser */
+#define json_outside	0
+#define json_key	1
+#define json_value	2
+
 /*
- * Entry point for worker loading
+ * State of parsing of one log file, kept between reads. Characters go to
+ * target, a field of record or key of jsonlog, or nowhere if it's NULL.
  */
-void
-_PG_init(void)
+typedef struct log_parser {
+    bool json;
+    LogRecord record;
+    char *target;
+    int *target_len;
+    int target_size;
+    /* csvlog: number of the field, whether it is quoted and a quote is just seen in it */
+    int field;
+    bool in_quotes;
+    bool quote_seen;
+    /*
+     * jsonlog: where the parser is, whether a key is over and backslash is
+     * just seen, hex digits of \\u escape left, its code point and a high
+     * surrogate before it
+     */
+    int json_state;
+    bool expect_value;
+    bool escape;
+    int unicode_digits;
+    pg_wchar unicode;
+    pg_wchar high_surrogate;
+    char key[32];
+    int key_len;
+} LogParser;
+
+/* Name of database or user and its oid, InvalidOid if there is no such one now */
+typedef struct backfill_name {
+    NameData name;
+    Oid oid;
+} BackfillName;
+
+typedef struct backfill_state {
+    TimestampTz since;
+    TimestampTz until;
+    /* Messages before minute_horizon fall into hour buckets, before hour_horizon nowhere */
+    TimestampTz minute_horizon;
+    TimestampTz hour_horizon;
+    /* BackfillEntry of every bucket and kind of message */
+    HTAB *counters;
+    HTAB *databases;
+    HTAB *users;
+    /* Text of start of the hour of the last timestamp, the start itself and whether it's valid */
+    char hour_text[96];
+    TimestampTz hour_start;
+    bool hour_valid;
+    uint64 counted_count;
+} BackfillState;
+
+static inline void
+log_parser_append(LogParser *parser, const char *data, int len)
 {
-    BackgroundWorker worker;
-    if (!process_shared_preload_libraries_in_progress) {
+    int room;
+    if (parser->target == NULL)
         return;
+    room = parser->target_size - 1 - *parser->target_len;
+    if (len > room)
+        len = room;
+    if (len > 0) {
+        memcpy(parser->target + *parser->target_len, data, len);
+        *parser->target_len += len;
     }
-    prev_shmem_startup_hook = shmem_startup_hook;
-    shmem_startup_hook = logerrors_shmem_startup;
-    prev_emit_log_hook = emit_log_hook;
-    emit_log_hook = logerrors_emit_log_hook;
-#if (PG_VERSION_NUM >= 150000)
-    prev_shmem_request_hook = shmem_request_hook;
-    shmem_request_hook = logerrors_shmem_request;
-#else
-    RequestAddinShmemSpace((sizeof(ErrorCode) + sizeof(ErrorName)) * error_codes_count + sizeof(GlobalInfo));
-#endif
-    /* Worker parameter and registration */
-    MemSet(&worker, 0, sizeof(BackgroundWorker));
-    worker.bgw_flags = BGWORKER_SHMEM_ACCESS;
-    worker.bgw_start_time = BgWorkerStart_PostmasterStart;
-    snprintf(worker.bgw_name, BGW_MAXLEN, "%s", worker_name);
-    sprintf(worker.bgw_library_name, "logerrors");
-    sprintf(worker.bgw_function_name, "logerrors_main");
-    /* Wait 10 seconds for restart after crash */
-    worker.bgw_restart_time = 10;
-    worker.bgw_main_arg = (Datum) 0;
-    worker.bgw_notify_pid = 0;
-    RegisterBackgroundWorker(&worker);
-    logerrors_load_params();
 }
 
-void
-_PG_fini(void)
-{
-    emit_log_hook = prev_emit_log_hook;
-    shmem_startup_hook = prev_shmem_startup_hook;
-}
+#define log_parser_set_target(parser, field) \
+    ((parser)->target = (parser)->record.field, \
+     (parser)->target_len = &(parser)->record.field##_len, \
+     (parser)->target_size = sizeof((parser)->record.field), \
+     (parser)->record.field##_len = 0)
 
+/* Fields of csvlog which backfill needs */
 static void
-logerrors_shmem_startup(void) {
-    bool found;
-    HASHCTL ctl;
-    if (prev_shmem_startup_hook)
-        prev_shmem_startup_hook();
-    error_names_hashtable = NULL;
-    global_variables = NULL;
-    memset(&ctl, 0, sizeof(ctl));
-    ctl.keysize = sizeof(ErrorCode);
-    ctl.entrysize = sizeof(ErrorName);
-    error_names_hashtable = ShmemInitHash("logerrors hash",
-#if PG_VERSION_NUM < 190000
-                                            error_codes_count, error_codes_count,
-#else
-					    error_codes_count,
-#endif
-                                            &ctl,
-#if PG_VERSION_NUM < 100000
-                                            HASH_ELEM);
-#else
-                                            HASH_ELEM | HASH_BLOBS);
-#endif
-    global_variables = ShmemInitStruct("logerrors global_variables",
-                                       sizeof(GlobalInfo),
-                                       &found);
-    if (!IsUnderPostmaster) {
-        global_variables_init();
-        logerrors_init();
+csvlog_set_target(LogParser *parser)
+{
+    switch (parser->field) {
+        case 0:
+            log_parser_set_target(parser, time);
+            break;
+        case 1:
+            log_parser_set_target(parser, user_name);
+            break;
+        case 2:
+            log_parser_set_target(parser, db_name);
+            break;
+        case 11:
+            log_parser_set_target(parser, severity);
+            break;
+        case 12:
+            log_parser_set_target(parser, sqlstate);
+            break;
+        default:
+            parser->target = NULL;
     }
-    return;
 }
 
-#if (PG_VERSION_NUM >= 150000)
-/*
- * Requests any additional shared memory required for our extension
- */
+/* Keys of jsonlog which backfill needs */
 static void
-logerrors_shmem_request(void)
+jsonlog_set_target(LogParser *parser)
 {
-    if (prev_shmem_request_hook)
-        prev_shmem_request_hook();
+    parser->key[parser->key_len] = '\0';
+    if (strcmp(parser->key, "timestamp") == 0)
+        log_parser_set_target(parser, time);
+    else if (strcmp(parser->key, "user") == 0)
+        log_parser_set_target(parser, user_name);
+    else if (strcmp(parser->key, "dbname") == 0)
+        log_parser_set_target(parser, db_name);
+    else if (strcmp(parser->key, "error_severity") == 0)
+        log_parser_set_target(parser, severity);
+    else if (strcmp(parser->key, "state_code") == 0)
+        log_parser_set_target(parser, sqlstate);
+    else
+        parser->target = NULL;
+}
 
-    RequestAddinShmemSpace((sizeof(ErrorCode) + sizeof(ErrorName)) * error_codes_count + sizeof(GlobalInfo));
+/* Forget the record, the next one starts */
+static void
+log_parser_next_record(LogParser *parser)
+{
+    parser->record.time_len = 0;
+    parser->record.user_name_len = 0;
+    parser->record.db_name_len = 0;
+    parser->record.severity_len = 0;
+    parser->record.sqlstate_len = 0;
+    parser->field = 0;
+    parser->in_quotes = false;
+    parser->quote_seen = false;
+    parser->json_state = json_outside;
+    parser->expect_value = false;
+    parser->escape = false;
+    parser->unicode_digits = 0;
+    parser->high_surrogate = 0;
+    if (parser->json)
+        parser->target = NULL;
+    else
+        csvlog_set_target(parser);
 }
-#endif
 
-PG_FUNCTION_INFO_V1(pg_log_errors_stats);
+static void backfill_count_record(BackfillState *state, LogRecord *record);
 
+/*
+ * Parse a part of csvlog. Fields are quoted with doubled quotes inside and
+ * may have newlines, quoted text up to the next quote is taken at once, so
+ * long messages cost about as much as memchr().
+ */
 static void
-count_up_errors(int duration_in_intervals, int current_interval, HTAB* counters_hashtable) {
-    bool found;
-    int i;
-    int j;
-    int interval_index;
-    int message_index;
-    MessageInfo key;
-    CounterHashElem* elem;
-    if (global_variables == NULL || counters_hashtable == NULL){
-        return;
-    }
-    /* put all messages to hashtable */
-    for (i = duration_in_intervals; i > 0; --i) {
-        interval_index = (current_interval - i + global_variables->actual_intervals_count)
-                % global_variables->actual_intervals_count;
-        for (j = 0; j < messages_per_interval; ++j) {
-            message_index = interval_index * messages_per_interval + j;
-            if (global_variables->messagesBuffer.buffer[message_index].error_code == -1)
+csvlog_parse(LogParser *parser, const char *data, int size, BackfillState *state)
+{
+    const char *p = data;
+    const char *end = data + size;
+    const char *quote;
+    char c;
+    while (p < end) {
+        if (parser->in_quotes) {
+            if (!parser->quote_seen) {
+                quote = memchr(p, '"', end - p);
+                if (quote == NULL) {
+                    log_parser_append(parser, p, end - p);
+                    return;
+                }
+                log_parser_append(parser, p, quote - p);
+                parser->quote_seen = true;
+                p = quote + 1;
+                continue;
+            }
+            parser->quote_seen = false;
+            if (*p == '"') {
+                log_parser_append(parser, p, 1);
+                p++;
                 continue;
-            key.db_oid = global_variables->messagesBuffer.buffer[message_index].db_oid;
-            key.user_oid = global_variables->messagesBuffer.buffer[message_index].user_oid;
-            key.error_code = global_variables->messagesBuffer.buffer[message_index].error_code;
-            key.message_type_index = global_variables->messagesBuffer.buffer[message_index].message_type_index;
-            elem = hash_search(counters_hashtable, (void *) &key, HASH_FIND, &found);
-            if (!found) {
-                elem = hash_search(counters_hashtable, (void *) &key, HASH_ENTER, &found);
-                elem->counter = 0;
             }
-            elem->counter++;
+            /* The quote closed the field */
+            parser->in_quotes = false;
         }
+        c = *p++;
+        if (c == '"')
+            parser->in_quotes = true;
+        else if (c == ',') {
+            parser->field++;
+            csvlog_set_target(parser);
+        } else if (c == '\n') {
+            backfill_count_record(state, &parser->record);
+            log_parser_next_record(parser);
+        } else
+            log_parser_append(parser, &c, 1);
     }
 }
 
+/*
+ * Append the character of a \\u escape, in UTF-8 if it's the server encoding.
+ * Other encodings get '?' for non-ASCII characters, the server escapes only
+ * control characters this way anyway.
+ */
 static void
-put_values_to_tuple(
-        int current_interval_index,
-        int duration_in_intervals,
-        HTAB* counters_hashtable,
-        TupleDesc tupdesc,
-        Tuplestorestate *tupstore){
-#define logerrors_COLS	7
-    Datum long_interval_values[logerrors_COLS];
-    bool long_interval_nulls[logerrors_COLS];
-    bool found;
-    int message_index;
-    int interval_index;
-    int i;
-    int j;
-    int k;
-    char* db_name;
-    char* user_name;
-    char err_name_str[100];
-    ErrorName* err_name;
-    MessageInfo key;
-    ErrorCode err_code;
-    CounterHashElem *elem;
-    if (global_variables == NULL || counters_hashtable == NULL){
+jsonlog_append_unicode(LogParser *parser)
+{
+    pg_wchar code = parser->unicode;
+    unsigned char utf8[4];
+    if (code >= 0xD800 && code <= 0xDBFF) {
+        parser->high_surrogate = code;
         return;
     }
-    count_up_errors(duration_in_intervals, current_interval_index, counters_hashtable);
-    for (i = duration_in_intervals; i > 0; --i) {
-        interval_index = (current_interval_index - i + global_variables->actual_intervals_count)
-                % global_variables->actual_intervals_count;
-        for (j = 0; j < messages_per_interval; ++j) {
-            message_index = interval_index * messages_per_interval + j;
-            if (global_variables->messagesBuffer.buffer[message_index].error_code == -1)
+    if (code >= 0xDC00 && code <= 0xDFFF) {
+        if (parser->high_surrogate == 0)
+            code = '?';
+        else
+            code = 0x10000 + ((parser->high_surrogate - 0xD800) << 10) + (code - 0xDC00);
+    }
+    parser->high_surrogate = 0;
+    if (code == 0)
+        return;
+    if (code < 0x80) {
+        utf8[0] = (unsigned char) code;
+        log_parser_append(parser, (const char *) utf8, 1);
+    } else if (GetDatabaseEncoding() == PG_UTF8) {
+        unicode_to_utf8(code, utf8);
+        log_parser_append(parser, (const char *) utf8, pg_utf_mblen(utf8));
+    } else
+        log_parser_append(parser, "?", 1);
+}
+
+/*
+ * Parse a part of jsonlog, one object of flat keys per line. Strings are
+ * taken up to the next quote or backslash at once, escapes are decoded.
+ */
+static void
+jsonlog_parse(LogParser *parser, const char *data, int size, BackfillState *state)
+{
+    const char *p = data;
+    const char *end = data + size;
+    const char *stop;
+    char c;
+    while (p < end) {
+        if (parser->json_state != json_outside) {
+            if (parser->unicode_digits > 0) {
+                c = *p++;
+                if (!isxdigit((unsigned char) c)) {
+                    /* Not an escape, take the character as it is */
+                    parser->unicode_digits = 0;
+                    p--;
+                    continue;
+                }
+                parser->unicode = parser->unicode * 16 +
+                                  (c >= 'a' ? c - 'a' + 10 : c >= 'A' ? c - 'A' + 10 : c - '0');
+                if (--parser->unicode_digits == 0)
+                    jsonlog_append_unicode(parser);
                 continue;
-            key.db_oid = global_variables->messagesBuffer.buffer[message_index].db_oid;
-            key.user_oid = global_variables->messagesBuffer.buffer[message_index].user_oid;
-            key.error_code = global_variables->messagesBuffer.buffer[message_index].error_code;
-            key.message_type_index = global_variables->messagesBuffer.buffer[message_index].message_type_index;
-            elem = hash_search(counters_hashtable, (void *) &key, HASH_FIND, &found);
-            if (!found) {
-                /* we already put this kind of message to output */
+            }
+            if (parser->escape) {
+                parser->escape = false;
+                c = *p++;
+                switch (c) {
+                    case 'b':
+                        c = '\b';
+                        break;
+                    case 'f':
+                        c = '\f';
+                        break;
+                    case 'n':
+                        c = '\n';
+                        break;
+                    case 'r':
+                        c = '\r';
+                        break;
+                    case 't':
+                        c = '\t';
+                        break;
+                    case 'u':
+                        parser->unicode_digits = 4;
+                        parser->unicode = 0;
+                        continue;
+                }
+                log_parser_append(parser, &c, 1);
                 continue;
             }
-
-            MemSet(long_interval_values, 0, sizeof(long_interval_values));
-            MemSet(long_interval_nulls, 0, sizeof(long_interval_nulls));
-            for (k = 0; k < logerrors_COLS; ++k) {
-                long_interval_nulls[k] = false;
+            for (stop = p; stop < end && *stop != '"' && *stop != '\\'; ++stop)
+                ;
+            log_parser_append(parser, p, stop - p);
+            if (stop == end)
+                return;
+            p = stop + 1;
+            if (*stop == '\\') {
+                parser->escape = true;
+                continue;
             }
-            /* Time interval */
-            long_interval_values[0] = DatumGetInt32(global_variables->interval * duration_in_intervals / 1000);
-            /* Type */
-            long_interval_values[1] = CStringGetTextDatum(message_type_names[key.message_type_index]);
-            /* Message */
-            err_code.num = key.error_code;
-            err_name = hash_search(error_names_hashtable, (void *) &err_code, HASH_FIND, &found);
-            if (found)
-                long_interval_values[2] = CStringGetTextDatum(err_name->name);
+            if (parser->json_state == json_key)
+                jsonlog_set_target(parser);
+            else
+                parser->target = NULL;
+            parser->json_state = json_outside;
+            continue;
+        }
+        c = *p++;
+        if (c == '"') {
+            if (parser->expect_value)
+                parser->json_state = json_value;
             else {
-                sprintf(err_name_str, "NOT_KNOWN_ERROR");
-                long_interval_values[2] = CStringGetTextDatum(err_name_str);
+                parser->json_state = json_key;
+                parser->target = parser->key;
+                parser->target_len = &parser->key_len;
+                parser->target_size = sizeof(parser->key);
+                parser->key_len = 0;
             }
-            /* Count */
-            long_interval_values[3] = DatumGetInt32(elem->counter);
-            /* Username */
-            user_name = get_user_by_oid(key.user_oid);
-            if (user_name == NULL)
-                long_interval_nulls[4] = true;
-            else
-                long_interval_values[4] = CStringGetTextDatum(user_name);
-            /* Database name */
-            db_name = get_database_name(key.db_oid);
-            if (db_name == NULL)
-                long_interval_nulls[5] = true;
-            else
-                long_interval_values[5] = CStringGetTextDatum(db_name);
+        } else if (c == ':')
+            parser->expect_value = true;
+        else if (c == ',') {
+            parser->expect_value = false;
+            parser->target = NULL;
+        } else if (c == '\n') {
+            backfill_count_record(state, &parser->record);
+            log_parser_next_record(parser);
+        }
+    }
+}
 
-            /* SQLState */
-            long_interval_values[6] = CStringGetTextDatum(unpack_sql_state(err_code.num));
+/*
+ * Parse a timestamp with time zone as timestamptz_in() does, but return false
+ * instead of an error if it's malformed or its zone abbreviation is unknown.
+ */
+static bool
+log_hour_parse(const char *text, TimestampTz *result)
+{
+    char workbuf[MAXDATELEN + MAXDATEFIELDS];
+    char *field[MAXDATEFIELDS];
+    int ftype[MAXDATEFIELDS];
+    int fields_count;
+    int dtype;
+    struct pg_tm tm;
+    fsec_t fsec;
+    int tz;
+#if PG_VERSION_NUM >= 160000
+    DateTimeErrorExtra extra;
+#endif
+    if (ParseDateTime(text, workbuf, sizeof(workbuf), field, ftype, MAXDATEFIELDS, &fields_count) != 0)
+        return false;
+#if PG_VERSION_NUM >= 160000
+    if (DecodeDateTime(field, ftype, fields_count, &dtype, &tm, &fsec, &tz, &extra) != 0)
+        return false;
+#else
+    if (DecodeDateTime(field, ftype, fields_count, &dtype, &tm, &fsec, &tz) != 0)
+        return false;
+#endif
+    return dtype == DTK_DATE && tm2timestamp(&tm, fsec, &tz, result) == 0;
+}
 
-            if (elem->counter > 0) {
-                tuplestore_putvalues(tupstore, tupdesc, long_interval_values, long_interval_nulls);
-            }
-            /* Now remove key from hashtable */
-            elem = hash_search(counters_hashtable, (void *) &key, HASH_REMOVE, &found);
+/*
+ * Time of a record as %m of log_line_prefix writes it: "YYYY-MM-DD
+ * HH:MI:SS.mmm TZ". Start of the hour is parsed once per hour and time zone,
+ * minutes and seconds are added to it. Records with a time which can't be
+ * parsed are skipped.
+ */
+static bool
+log_time_parse(BackfillState *state, const LogRecord *record, TimestampTz *time)
+{
+    static const char pattern[] = "dddd-dd-dd dd:dd:dd";
+    const char *text = record->time;
+    char hour_text[sizeof(state->hour_text)];
+    int64 fraction = 0;
+    int digits = 0;
+    int minutes;
+    int seconds;
+    int i;
+    if (record->time_len < (int) sizeof(pattern) - 1)
+        return false;
+    for (i = 0; i < (int) sizeof(pattern) - 1; ++i) {
+        if (pattern[i] == 'd' ? !isdigit((unsigned char) text[i]) : text[i] != pattern[i])
+            return false;
+    }
+    if (i < record->time_len && text[i] == '.') {
+        for (++i; i < record->time_len && isdigit((unsigned char) text[i]); ++i) {
+            if (digits++ < 6)
+                fraction = fraction * 10 + (text[i] - '0');
         }
+        for (; digits < 6; ++digits)
+            fraction *= 10;
+    }
+    /* The rest is time zone */
+    memcpy(hour_text, text, 13);
+    memcpy(hour_text + 13, ":00:00", 6);
+    memcpy(hour_text + 19, text + i, record->time_len - i);
+    hour_text[19 + record->time_len - i] = '\0';
+    if (strcmp(hour_text, state->hour_text) != 0) {
+        state->hour_valid = log_hour_parse(hour_text, &state->hour_start);
+        strcpy(state->hour_text, hour_text);
     }
+    minutes = (text[14] - '0') * 10 + (text[15] - '0');
+    seconds = (text[17] - '0') * 10 + (text[18] - '0');
+    if (!state->hour_valid || minutes >= MINS_PER_HOUR || seconds > SECS_PER_MINUTE)
+        return false;
+    *time = state->hour_start + (minutes * SECS_PER_MINUTE + seconds) * USECS_PER_SEC + fraction;
+    return true;
 }
 
+static Oid
+backfill_name_oid(HTAB *names, const char *name, bool database)
+{
+    NameData key;
+    BackfillName *entry;
+    bool found;
+    if (name[0] == '\0')
+        return InvalidOid;
+    memset(&key, 0, sizeof(key));
+    strlcpy(NameStr(key), name, NAMEDATALEN);
+    entry = hash_search(names, (void *) &key, HASH_ENTER, &found);
+    if (!found)
+        entry->oid = database ? get_database_oid(name, true) : get_role_oid(name, true);
+    return entry->oid;
+}
 
-Datum
-pg_log_errors_stats(PG_FUNCTION_ARGS)
+/*
+ * Count a message of the record if it is one of message types and is in time.
+ * Severity is written translated to lc_messages, only English names match.
+ */
+static void
+backfill_count_record(BackfillState *state, LogRecord *record)
 {
-#define logerrors_COLS	7
-    ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
-    TupleDesc	tupdesc;
-    Tuplestorestate *tupstore;
-    MemoryContext per_query_ctx;
-    MemoryContext oldcontext;
-    HASHCTL ctl;
-    HTAB* counters_hashtable;
-    Datum long_interval_values[logerrors_COLS];
+    BackfillKey key;
+    BackfillEntry *entry;
+    TimestampTz time;
+    int message_type_index;
+    int error_code;
+    bool found;
 
-    bool long_interval_nulls[logerrors_COLS];
-    int current_interval_index;
-    int lvl_i;
-    int j;
-    /* Shmem structs not ready yet */
-    if (error_names_hashtable == NULL || global_variables == NULL) {
-        ereport(ERROR,
-                (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
-                        errmsg("logerrors must be loaded via shared_preload_libraries")));
+    record->severity[record->severity_len] = '\0';
+    for (message_type_index = 0; message_type_index < message_types_count; ++message_type_index) {
+        if (strcmp(record->severity, message_type_names[message_type_index]) == 0)
+            break;
     }
-    /* check to see if caller supports us returning a tuplestore */
-    if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
-        ereport(ERROR,
-                (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-                        errmsg("set-valued function called in context that cannot accept a set")));
-    if (!(rsinfo->allowedModes & SFRM_Materialize))
-        ereport(ERROR,
-                (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-                        errmsg("materialize mode required, but it is not allowed in this context")));
+    if (message_type_index == message_types_count || record->sqlstate_len != len_sqlstate_str)
+        return;
+    if (!log_time_parse(state, record, &time) || time < state->since || time >= state->until ||
+        time < state->hour_horizon)
+        return;
+    error_code = MAKE_SQLSTATE(record->sqlstate[0], record->sqlstate[1], record->sqlstate[2],
+                               record->sqlstate[3], record->sqlstate[4]);
+    if (!errcodes_filter_counts(error_code))
+        return;
+    record->user_name[record->user_name_len] = '\0';
+    record->db_name[record->db_name_len] = '\0';
 
-    /* Build a tuple descriptor for our result type */
-    if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+    memset(&key, 0, sizeof(key));
+    key.hourly = time < state->minute_horizon;
+    key.bucket_start = period_start(time, key.hourly ? USECS_PER_HOUR : USECS_PER_MINUTE);
+    key.info.error_code = error_code;
+    key.info.db_oid = backfill_name_oid(state->databases, record->db_name, true);
+    key.info.user_oid = backfill_name_oid(state->users, record->user_name, false);
+    key.info.message_type_index = message_type_index;
+    if (hash_get_num_entries(state->counters) < backfill_max_keys)
+        entry = hash_search(state->counters, (void *) &key, HASH_ENTER, &found);
+    else {
+        entry = hash_search(state->counters, (void *) &key, HASH_FIND, &found);
+        if (entry == NULL) {
+            memset(&key.info, 0, sizeof(key.info));
+            key.info.message_type_index = message_type_index;
+            key.overflow = true;
+            entry = hash_search(state->counters, (void *) &key, HASH_ENTER, &found);
+        }
+    }
+    if (!found)
+        entry->count = 0;
+    entry->count++;
+    state->counted_count++;
+}
+
+static void
+backfill_read_file(BackfillState *state, const char *path, bool json, char *buffer)
+{
+    FILE *file;
+    LogParser parser;
+    size_t read_size;
+    file = AllocateFile(path, PG_BINARY_R);
+    if (file == NULL) {
+        /* Removed by rotation meanwhile */
+        if (errno == ENOENT)
+            return;
         ereport(ERROR,
-                (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-                        errmsg("return type must be a row type")));
+                (errcode_for_file_access(),
+                        errmsg("could not open file \"%s\": %m", path)));
+    }
+    memset(&parser, 0, sizeof(parser));
+    parser.json = json;
+    log_parser_next_record(&parser);
+    /* A record without newline at the end is still being written */
+    while ((read_size = fread(buffer, 1, backfill_read_size, file)) > 0) {
+        if (json)
+            jsonlog_parse(&parser, buffer, (int) read_size, state);
+        else
+            csvlog_parse(&parser, buffer, (int) read_size, state);
+        CHECK_FOR_INTERRUPTS();
+    }
+    if (ferror(file)) {
+        FreeFile(file);
+        ereport(ERROR,
+                (errcode_for_file_access(),
+                        errmsg("could not read file \"%s\": %m", path)));
+    }
+    FreeFile(file);
+}
 
-    counters_hashtable = NULL;
+static HTAB *
+backfill_hash_create(const char *name, Size keysize, Size entrysize)
+{
+    HASHCTL ctl;
     memset(&ctl, 0, sizeof(ctl));
-    ctl.keysize = sizeof(MessageInfo);
-    ctl.entrysize = sizeof(CounterHashElem);
-    /* an unshared hashtable can be expanded on-the-fly */
+    ctl.keysize = keysize;
+    ctl.entrysize = entrysize;
+    /* Freed together with the call */
+    ctl.hcxt = CurrentMemoryContext;
 #if PG_VERSION_NUM < 100000
-    counters_hashtable = hash_create("counters hashtable", 1, &ctl, HASH_ELEM);
+    return hash_create(name, 1024, &ctl, HASH_ELEM | HASH_CONTEXT);
 #else
-    counters_hashtable = hash_create("counters hashtable", 1, &ctl, HASH_ELEM | HASH_BLOBS);
+    return hash_create(name, 1024, &ctl, HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
 #endif
+}
 
-    per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
-    oldcontext = MemoryContextSwitchTo(per_query_ctx);
+static bool
+has_suffix(const char *name, const char *suffix)
+{
+    size_t name_len = strlen(name);
+    size_t suffix_len = strlen(suffix);
+    return name_len > suffix_len && strcmp(name + name_len - suffix_len, suffix) == 0;
+}
 
-    tupstore = tuplestore_begin_heap(true, false, work_mem);
-    rsinfo->returnMode = SFRM_Materialize;
-    rsinfo->setResult = tupstore;
-    rsinfo->setDesc = tupdesc;
-    MemoryContextSwitchTo(oldcontext);
+static int
+backfill_entry_cmp(const void *a, const void *b)
+{
+    TimestampTz start_a = ((const BackfillEntry *) a)->key.bucket_start;
+    TimestampTz start_b = ((const BackfillEntry *) b)->key.bucket_start;
+    if (start_a == start_b)
+        return 0;
+    return start_a > start_b ? -1 : 1;
+}
 
-    current_interval_index = pg_atomic_read_u64(&global_variables->messagesBuffer.current_interval_index) % (uint64)global_variables->actual_intervals_count;
-    /* 'TOTAL' counters */
-    for (lvl_i = 0; lvl_i < message_types_count; ++lvl_i) {
+/* Let another backfill start, also if this one fails */
+static void
+backfill_queue_release(int code, Datum arg)
+{
+    SpinLockAcquire(&backfill_queue->mutex);
+    if (backfill_queue->owner_pid == MyProcPid)
+        backfill_queue->owner_pid = 0;
+    SpinLockRelease(&backfill_queue->mutex);
+}
 
-        /* Add total count to result */
-        MemSet(long_interval_values, 0, sizeof(long_interval_values));
-        MemSet(long_interval_nulls, 0, sizeof(long_interval_nulls));
-        for (j = 0; j < logerrors_COLS; ++j) {
-            long_interval_nulls[j] = false;
+/*
+ * Pass counters to the worker, newest bucket first, and wait until it
+ * applies them. Fails if the worker isn't running or applies nothing for
+ * advance_interval_timeout seconds; buckets already applied stay applied
+ * then, and counters already queued are applied when the worker is back
+ * unless another backfill starts first.
+ */
+static void
+backfill_queue_send(BackfillEntry *entries, int count)
+{
+    Latch *worker_latch;
+    int sent = 0;
+    int batch;
+    bool applied;
+    uint64 applied_count;
+    uint64 last_applied_count = 0;
+    TimestampTz last_progress;
+    last_progress = GetCurrentTimestamp();
+    for (;;) {
+        SpinLockAcquire(&backfill_queue->mutex);
+        batch = Min(count - sent, backfill_queue_size - backfill_queue->used_count);
+        memcpy(&backfill_queue->entries[backfill_queue->used_count], &entries[sent], sizeof(BackfillEntry) * batch);
+        backfill_queue->used_count += batch;
+        backfill_queue->queued_count += batch;
+        applied_count = backfill_queue->applied_count;
+        applied = (applied_count == backfill_queue->queued_count);
+        SpinLockRelease(&backfill_queue->mutex);
+        sent += batch;
+        if (sent == count && applied)
+            break;
+        if (applied_count != last_applied_count) {
+            last_applied_count = applied_count;
+            last_progress = GetCurrentTimestamp();
+        } else if (TimestampDifferenceExceeds(last_progress, GetCurrentTimestamp(),
+                                              advance_interval_timeout * 1000)) {
+            if (global_variables->worker_latch == NULL)
+                ereport(ERROR,
+                        (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+                                errmsg("logerrors worker is not running")));
+            ereport(ERROR,
+                    (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+                            errmsg("logerrors worker has not applied backfilled counters for %d seconds",
+                                   advance_interval_timeout)));
         }
-        /* Time interval */
-        long_interval_nulls[0] = true;
-        /* Type */
-        long_interval_values[1] = CStringGetTextDatum(message_type_names[lvl_i]);
-        /* Message */
-        long_interval_values[2] = CStringGetTextDatum("TOTAL");
-        /* Count */
-        long_interval_values[3] = DatumGetInt32(pg_atomic_read_u32(&global_variables->total_count[lvl_i]));
-        /* Username */
-        long_interval_nulls[4] = true;
-        /* Database name */
-        long_interval_nulls[5] = true;
-        /* sqlstate */
-        long_interval_nulls[6] = true;
-        tuplestore_putvalues(tupstore, tupdesc, long_interval_values, long_interval_nulls);
+        worker_latch = global_variables->worker_latch;
+        if (batch > 0 && worker_latch != NULL)
+            SetLatch(worker_latch);
+        pg_usleep(1000L);
+        CHECK_FOR_INTERRUPTS();
     }
-    /* short interval counters */
-    put_values_to_tuple(current_interval_index, 1, counters_hashtable, tupdesc, tupstore);
-    /* long interval counters */
-    put_values_to_tuple(current_interval_index, global_variables->intervals_count, counters_hashtable, tupdesc,
-            tupstore);
-    /* clean up */
-    hash_destroy(counters_hashtable);
-    return (Datum) 0;
 }
 
-PG_FUNCTION_INFO_V1(pg_log_errors_reset);
+PG_FUNCTION_INFO_V1(pg_log_errors_backfill);
 
+/*
+ * Count messages of csvlog and jsonlog files in log_directory written in
+ * [since, until) into buckets of rollup tiers. Tiers are filled back from
+ * their oldest bucket, time which already has statistics is skipped.
+ * Returns count of messages read, messages older than free buckets of
+ * tiers reach are read but dropped. Reads any log file, so only superusers
+ * may call it unless granted.
+ */
 Datum
-pg_log_errors_reset(PG_FUNCTION_ARGS) {
+pg_log_errors_backfill(PG_FUNCTION_ARGS)
+{
+    TimestampTz since = PG_GETARG_TIMESTAMPTZ(0);
+    TimestampTz until = PG_GETARG_TIMESTAMPTZ(1);
+    BackfillState state;
+    RollupTier *minute_tier;
+    RollupTier *hour_tier;
+    HASH_SEQ_STATUS status;
+    BackfillEntry *entry;
+    BackfillEntry *entries;
+    int entries_count;
+    DIR *dir;
+    struct dirent *de;
+    struct stat st;
+    char path[MAXPGPATH];
+    char *buffer;
+    int owner_pid;
 
-    if (error_names_hashtable == NULL || global_variables == NULL) {
+    if (global_variables == NULL) {
         ereport(ERROR,
                 (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
                         errmsg("logerrors must be loaded via shared_preload_libraries")));
     }
+    minute_tier = get_rollup_tier(0);
+    hour_tier = get_rollup_tier(1);
+    if (since >= until || minute_tier->buckets_count + hour_tier->buckets_count == 0)
+        PG_RETURN_INT64(0);
 
-    logerrors_init();
-
-    PG_RETURN_VOID();
-}
-
-PG_FUNCTION_INFO_V1(pg_slow_log_stats);
+    MemSet(&state, 0, sizeof(state));
+    state.since = since;
+    state.until = until;
+    state.minute_horizon = until - minute_tier->buckets_count * rollup_tier_periods[0];
+    state.hour_horizon = hour_tier->buckets_count > 0
+                         ? Min(until - hour_tier->buckets_count * rollup_tier_periods[1], state.minute_horizon)
+                         : state.minute_horizon;
+    state.counters = backfill_hash_create("logerrors backfill counters", sizeof(BackfillKey), sizeof(BackfillEntry));
+    state.databases = backfill_hash_create("logerrors backfill databases", sizeof(NameData), sizeof(BackfillName));
+    state.users = backfill_hash_create("logerrors backfill users", sizeof(NameData), sizeof(BackfillName));
+    buffer = palloc(backfill_read_size);
 
-Datum
-pg_slow_log_stats(PG_FUNCTION_ARGS)
-{
-#define SLOW_LOG_COLS 2
-    ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
-    Tuplestorestate *tupstore;
-    TupleDesc tupdesc;
-    MemoryContext per_query_ctx;
-    MemoryContext oldcontext;
-    int i;
+    dir = AllocateDir(Log_directory);
+    while ((de = ReadDir(dir, Log_directory)) != NULL) {
+        if (!has_suffix(de->d_name, ".csv") && !has_suffix(de->d_name, ".json"))
+            continue;
+        snprintf(path, sizeof(path), "%s/%s", Log_directory, de->d_name);
+        if (stat(path, &st) != 0 || !S_ISREG(st.st_mode))
+            continue;
+        /* Nothing in the file was written after it was modified */
+        if (time_t_to_timestamptz(st.st_mtime) < since)
+            continue;
+        backfill_read_file(&state, path, has_suffix(de->d_name, ".json"), buffer);
+    }
+    FreeDir(dir);
+    pfree(buffer);
 
-    Datum result_values[SLOW_LOG_COLS];
-    bool result_nulls[SLOW_LOG_COLS];
+    entries_count = (int) hash_get_num_entries(state.counters);
+    if (entries_count == 0)
+        PG_RETURN_INT64(0);
+    entries = palloc(sizeof(BackfillEntry) * entries_count);
+    entries_count = 0;
+    hash_seq_init(&status, state.counters);
+    while ((entry = hash_seq_search(&status)) != NULL)
+        entries[entries_count++] = *entry;
+    qsort(entries, entries_count, sizeof(BackfillEntry), backfill_entry_cmp);
 
-    /* Shmem structs not ready yet */
-    if (global_variables == NULL) {
-         ereport(ERROR,
-				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
-				 errmsg("logerrors must be loaded via shared_preload_libraries")));
+    /* Counters of one backfill must not mix with another one */
+    SpinLockAcquire(&backfill_queue->mutex);
+    owner_pid = backfill_queue->owner_pid;
+    if (owner_pid == 0) {
+        backfill_queue->owner_pid = MyProcPid;
+        backfill_queue->backfill_id++;
+        backfill_queue->queued_count = 0;
+        backfill_queue->applied_count = 0;
+        backfill_queue->used_count = 0;
     }
-    /* check to see if caller supports us returning a tuplestore */
-    if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
-        ereport(ERROR,
-                (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-                        errmsg("set-valued function called in context that cannot accept a set")));
-    if (!(rsinfo->allowedModes & SFRM_Materialize))
-        ereport(ERROR,
-                (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-                        errmsg("materialize mode required, but it is not allowed in this context")));
-
-    /* Build a tuple descriptor for our result type */
-    if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+    SpinLockRelease(&backfill_queue->mutex);
+    if (owner_pid != 0)
         ereport(ERROR,
-                (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-                        errmsg("return type must be a row type")));
-
-    per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
-    oldcontext = MemoryContextSwitchTo(per_query_ctx);
-
-    tupstore = tuplestore_begin_heap(true, false, work_mem);
-    rsinfo->returnMode = SFRM_Materialize;
-    rsinfo->setResult = tupstore;
-    rsinfo->setDesc = tupdesc;
-    MemoryContextSwitchTo(oldcontext);
-
-    MemSet(result_values, 0, sizeof(result_values));
-    MemSet(result_nulls, 0, sizeof(result_nulls));
-    for (i = 0; i < SLOW_LOG_COLS; i++) {
-        result_nulls[i] = false;
+                (errcode(ERRCODE_OBJECT_IN_USE),
+                        errmsg("logerrors statistics are being backfilled by process %d", owner_pid)));
+    PG_ENSURE_ERROR_CLEANUP(backfill_queue_release, (Datum) 0);
+    {
+        backfill_queue_send(entries, entries_count);
     }
-    result_values[0] = DatumGetInt32(pg_atomic_read_u32(&global_variables->slow_log_info.count));
-    result_values[1] = DatumGetTimestamp(pg_atomic_read_u64(&global_variables->slow_log_info.reset_time));
-
-    tuplestore_putvalues(tupstore, tupdesc, result_values, result_nulls);
-    return (Datum) 0;
+    PG_END_ENSURE_ERROR_CLEANUP(backfill_queue_release, (Datum) 0);
+    backfill_queue_release(0, (Datum) 0);
+    pfree(entries);
+    PG_RETURN_INT64((int64) state.counted_count);
 }
@@ -0,0 +1,71 @@
+ALTER SYSTEM SET logerrors.alert_rules = 'ERRCODE_DIVISION_BY_ZERO > 2, XX001 > 3 sigma, 22*** > 100, 57P01 >, * > 20';
+SELECT pg_reload_conf();
+SELECT pg_sleep(1);
+SET ROLE postgres;
+SET client_min_messages = error;
+SELECT pg_log_errors_reset();
+SELECT pg_log_errors_advance_interval();
+-- Above threshold of the rule
+DO LANGUAGE plpgsql $$
+BEGIN
+    FOR i IN 1 .. 3 LOOP
+        RAISE WARNING USING ERRCODE = '22012', MESSAGE = 'logerrors alerts';
+    END LOOP;
+END;
+$$;
+SELECT pg_log_errors_advance_interval();
+-- Still above, the alert doesn't fire again
+DO LANGUAGE plpgsql $$
+BEGIN
+    FOR i IN 1 .. 3 LOOP
+        RAISE WARNING USING ERRCODE = '22012', MESSAGE = 'logerrors alerts';
+    END LOOP;
+END;
+$$;
+SELECT pg_log_errors_advance_interval();
+-- Below and above again
+SELECT pg_log_errors_advance_interval();
+DO LANGUAGE plpgsql $$
+BEGIN
+    FOR i IN 1 .. 3 LOOP
+        RAISE WARNING USING ERRCODE = '22012', MESSAGE = 'logerrors alerts';
+    END LOOP;
+END;
+$$;
+SELECT pg_log_errors_advance_interval();
+-- Steady count for a baseline, then a spike
+DO LANGUAGE plpgsql $$
+BEGIN
+    FOR i IN 1 .. 10 LOOP
+        RAISE WARNING USING ERRCODE = 'XX001', MESSAGE = 'logerrors alerts';
+        PERFORM pg_log_errors_advance_interval();
+    END LOOP;
+    FOR i IN 1 .. 10 LOOP
+        RAISE WARNING USING ERRCODE = 'XX001', MESSAGE = 'logerrors alerts';
+    END LOOP;
+END;
+$$;
+SELECT pg_log_errors_advance_interval();
+-- A backend counts 32 kinds between ticks, the rest overflow and have a baseline of their type
+DO LANGUAGE plpgsql $$
+BEGIN
+    FOR i IN 0 .. 31 LOOP
+        RAISE WARNING USING ERRCODE = 'Y' || lpad(i::text, 4, '0'), MESSAGE = 'logerrors alerts';
+    END LOOP;
+    FOR i IN 1 .. 25 LOOP
+        RAISE WARNING USING ERRCODE = 'Y0032', MESSAGE = 'logerrors alerts';
+    END LOOP;
+END;
+$$;
+SELECT pg_log_errors_advance_interval();
+SELECT rule, type, message, sqlstate, count, threshold,
+       round(baseline::numeric, 2) AS baseline, round(stddev::numeric, 2) AS stddev
+FROM pg_log_errors_alerts();
+SELECT pg_log_errors_reset();
+SELECT pg_log_errors_advance_interval();
+SELECT count(*) FROM pg_log_errors_alerts();
+RESET client_min_messages;
+RESET ROLE;
+ALTER SYSTEM RESET logerrors.alert_rules;
+SELECT pg_reload_conf();
+SELECT pg_sleep(1);
@@ -0,0 +1,25 @@
+SET ROLE postgres;
+SELECT pg_log_errors_reset();
+SELECT 1/0;
+SELECT pg_log_errors_advance_interval();
+SELECT type, message, sqlstate, database, username, count
+    FROM pg_log_errors_changes() WHERE type IS NOT NULL;
+SELECT max(high_water) AS high_water FROM pg_log_errors_changes() \gset
+SELECT 1/0;
+SELECT 1/0;
+SELECT pg_log_errors_advance_interval();
+-- Only intervals closed after the given one
+SELECT type, message, sum(count), bool_and(sequence > :high_water AND sequence <= high_water) AS newer
+    FROM pg_log_errors_changes(:high_water) WHERE type IS NOT NULL
+    GROUP BY type, message;
+-- Nothing is newer than the high water mark
+SELECT sequence, type, count, high_water IS NOT NULL AS has_high_water
+    FROM pg_log_errors_changes((SELECT max(high_water) FROM pg_log_errors_changes()));
+-- No gap after the high water mark
+SELECT first_sequence = high_water + 1 AS no_gap
+    FROM pg_log_errors_changes((SELECT max(high_water) FROM pg_log_errors_changes()));
+-- Intervals after since were reset before they were read
+SELECT pg_log_errors_reset();
+SELECT pg_log_errors_advance_interval();
+SELECT DISTINCT first_sequence > :high_water + 1 AS gap
+    FROM pg_log_errors_changes(:high_water);
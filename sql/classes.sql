@@ -0,0 +1,26 @@
+SET ROLE postgres;
+SELECT pg_log_errors_reset();
+SELECT pg_log_errors_advance_interval();
+SELECT 1/0;
+SELECT sqrt(-1);
+DO LANGUAGE plpgsql $$
+BEGIN
+    RAISE WARNING USING ERRCODE = '08006', MESSAGE = 'logerrors classes';
+    -- Class which is not in errcodes.txt
+    RAISE WARNING USING ERRCODE = 'Y0001', MESSAGE = 'logerrors classes other';
+END;
+$$;
+SELECT pg_log_errors_advance_interval();
+SELECT time_interval, type, class, message, count FROM pg_log_errors_classes();
+-- The last interval moves on, the window and totals keep counts
+SELECT 1/0;
+SELECT pg_log_errors_advance_interval();
+SELECT time_interval, type, class, message, count FROM pg_log_errors_classes();
+-- Totals of classes add up to TOTAL
+SELECT c.type, c.count = s.count AS matches
+    FROM (SELECT type, sum(count) AS count FROM pg_log_errors_classes() WHERE time_interval IS NULL GROUP BY type) c
+    JOIN pg_log_errors_stats() s ON s.type = c.type AND s.message = 'TOTAL'
+    ORDER BY c.type;
+SELECT pg_log_errors_reset();
+SELECT count(*) FROM pg_log_errors_classes();
+RESET ROLE;
@@ -0,0 +1,14 @@
+SET ROLE postgres;
+SELECT pg_log_errors_reset();
+SELECT 1/0;
+SELECT 1/0;
+SELECT pg_log_errors_advance_interval();
+SELECT type, message, sqlstate, database, username, count FROM pg_log_errors_counters();
+-- Counters keep growing after intervals close
+SELECT 1/0;
+SELECT pg_log_errors_advance_interval();
+SELECT type, message, count,
+       dbid = (SELECT oid FROM pg_database WHERE datname = current_database()) AS dbid_matches
+    FROM pg_log_errors_counters();
+SELECT pg_log_errors_reset();
+SELECT count(*) FROM pg_log_errors_counters();
@@ -0,0 +1,18 @@
+ALTER SYSTEM SET logerrors.dimensions = 'application_name, backend_type';
+SELECT pg_reload_conf();
+SELECT pg_sleep(1);
+SELECT pg_log_errors_reset();
+SET application_name = 'logerrors_web';
+SELECT 1/0;
+SET application_name = 'logerrors_batch';
+SELECT 1/0;
+SELECT 1/0;
+RESET application_name;
+SELECT pg_log_errors_advance_interval();
+-- Messages of each application are counted apart, client address is not asked for
+SELECT message, count, application_name, backend_type, client_addr
+    FROM pg_log_errors_stats_filtered(filter_sqlstate => '22012') WHERE time_interval = 600
+    ORDER BY application_name;
+ALTER SYSTEM RESET logerrors.dimensions;
+SELECT pg_reload_conf();
+SELECT pg_sleep(1);
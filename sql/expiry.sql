@@ -0,0 +1,33 @@
+SET ROLE postgres;
+SELECT pg_log_errors_reset();
+SELECT 1/0;
+SELECT pg_log_errors_advance_interval();
+SELECT type, message, count FROM pg_log_errors_stats() WHERE time_interval = 600;
+-- The window keeps intervals_count intervals, the message is in the oldest one now
+SELECT pg_log_errors_advance_interval(119);
+SELECT type, message, count FROM pg_log_errors_stats() WHERE time_interval = 600;
+-- And leaves the window with the next one
+SELECT pg_log_errors_advance_interval();
+SELECT count(*) FROM pg_log_errors_stats() WHERE time_interval = 600;
+-- The ring of intervals goes round
+SELECT pg_log_errors_advance_interval(10);
+SELECT pg_log_errors_verify_window();
+SELECT count(*) FROM pg_log_errors_stats() WHERE time_interval IS NOT NULL;
+-- Minute buckets and counters still have the message
+SELECT type, message, sum(count) FROM pg_log_errors_history(now() - interval '1 hour') GROUP BY type, message;
+SELECT type, message, count FROM pg_log_errors_counters();
+-- Messages beyond slots a backend has between intervals are counted only by type
+SET client_min_messages = error;
+DO LANGUAGE plpgsql $$
+BEGIN
+    FOR i IN 1..40 LOOP
+        RAISE WARNING USING ERRCODE = 'Y' || lpad(i::text, 4, '0'), MESSAGE = 'logerrors expiry overflow';
+    END LOOP;
+END;
+$$;
+RESET client_min_messages;
+SELECT pg_log_errors_advance_interval();
+SELECT message = 'OVERFLOW' AS overflow, count(*) AS kinds, sum(count)
+    FROM pg_log_errors_stats() WHERE time_interval = 600 AND type = 'WARNING'
+    GROUP BY 1 ORDER BY 1;
+SELECT pg_log_errors_verify_window();
@@ -0,0 +1,25 @@
+ALTER SYSTEM SET logerrors.included_errcodes = '22***, XX001';
+ALTER SYSTEM SET logerrors.excluded_errcodes = '22012';
+SELECT pg_reload_conf();
+SELECT pg_sleep(1);
+SET ROLE postgres;
+SELECT pg_log_errors_reset();
+-- Included by class but excluded by code
+SELECT 1/0;
+-- Included by class
+SELECT sqrt(-1);
+DO LANGUAGE plpgsql $$
+BEGIN
+    -- Included by code
+    RAISE WARNING USING ERRCODE = 'XX001', MESSAGE = 'logerrors filter included';
+    -- Not included
+    RAISE WARNING USING ERRCODE = 'XX002', MESSAGE = 'logerrors filter not included';
+    RAISE WARNING USING ERRCODE = '01000', MESSAGE = 'logerrors filter other class';
+END;
+$$;
+SELECT pg_log_errors_advance_interval();
+SELECT type, message, count, sqlstate FROM pg_log_errors_stats() WHERE time_interval = 600;
+RESET ROLE;
+ALTER SYSTEM RESET logerrors.included_errcodes;
+ALTER SYSTEM RESET logerrors.excluded_errcodes;
+SELECT pg_reload_conf();
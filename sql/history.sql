@@ -0,0 +1,16 @@
+SET ROLE postgres;
+SELECT pg_log_errors_reset();
+SELECT 1/0;
+SELECT 1/0;
+SELECT pg_log_errors_advance_interval();
+SELECT type, message, sqlstate, database, username, sum(count)
+    FROM pg_log_errors_history(now() - interval '5 minutes')
+    GROUP BY type, message, sqlstate, database, username;
+-- Intervals follow one another
+SELECT bool_and(bucket_start < bucket_end) FROM pg_log_errors_history(now() - interval '5 minutes');
+SELECT count(*) FROM pg_log_errors_history(now() + interval '1 day');
+-- Longer ranges are read from minute and hour buckets, which count the same
+SELECT type, message, sum(count) FROM pg_log_errors_history(now() - interval '1 hour') GROUP BY type, message;
+SELECT type, message, sum(count) FROM pg_log_errors_history(now() - interval '7 days') GROUP BY type, message;
+-- Reads log files, only superusers may call it unless granted
+SELECT pg_log_errors_backfill(now() - interval '1 hour');
@@ -0,0 +1,8 @@
+SET ROLE postgres;
+SELECT 1/0;
+SELECT pg_log_errors_advance_interval();
+SELECT count(*) > 0 AS has_rows FROM pg_log_errors_stats();
+SELECT hook_calls > 0 AS hooked, hook_timed_calls <= hook_calls AS timed_some,
+       ticks > 0 AS ticked, tick_lag_ms >= 0 AND tick_lag_ms <= tick_lag_max_ms AS lag_in_range,
+       stats_scan_entries > 0 AS scanned, stats_scan_ms >= 0 AS scan_timed
+    FROM pg_log_errors_internal_stats();
@@ -1,7 +1,10 @@
+-- Intervals are closed by pg_log_errors_advance_interval() with logerrors.manual_clock of logerrors.conf
+GRANT EXECUTE ON FUNCTION pg_log_errors_advance_interval(integer) TO postgres;
+GRANT EXECUTE ON FUNCTION pg_log_errors_verify_window() TO postgres;
 SET ROLE postgres;
 SELECT pg_log_errors_reset();
 SELECT blah();
-SELECT pg_sleep(10);
+SELECT pg_log_errors_advance_interval(2);
 SELECT * FROM pg_log_errors_stats();
 DO LANGUAGE plpgsql $$
 BEGIN
@@ -13,5 +16,5 @@ BEGIN
     RAISE SQLSTATE 'XXXXY';
 END;
 $$;
-SELECT pg_sleep(5);
+SELECT pg_log_errors_advance_interval();
 SELECT * FROM pg_log_errors_stats();
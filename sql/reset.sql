@@ -0,0 +1,14 @@
+SET ROLE postgres;
+SELECT 1/0;
+SELECT pg_log_errors_advance_interval();
+SELECT pg_log_errors_reset();
+-- Messages counted before reset are gone, even before the worker applies it
+SELECT count(*) FROM pg_log_errors_stats() WHERE message <> 'TOTAL';
+SELECT count(*) FROM pg_log_errors_top();
+SELECT type, count FROM pg_log_errors_stats() WHERE message = 'TOTAL';
+SELECT slow_count FROM pg_slow_log_stats();
+SELECT 1/0;
+SELECT pg_log_errors_advance_interval(2);
+-- Messages counted after reset are kept
+SELECT type, message, count FROM pg_log_errors_stats() WHERE type = 'ERROR';
+SELECT pg_log_errors_verify_window();
@@ -0,0 +1,15 @@
+SELECT pg_log_errors_reset();
+SELECT 1/0;
+SELECT pg_log_errors_advance_interval();
+-- Intervals move to a ring of the new size on reload, the window is counted up again
+ALTER SYSTEM SET logerrors.intervals_count = 30;
+SELECT pg_reload_conf();
+SELECT pg_sleep(1);
+SELECT pg_log_errors_verify_window();
+SELECT type, message, count FROM pg_log_errors_stats() WHERE time_interval = 150;
+-- And back to the fixed shared memory
+ALTER SYSTEM RESET logerrors.intervals_count;
+SELECT pg_reload_conf();
+SELECT pg_sleep(1);
+SELECT pg_log_errors_verify_window();
+SELECT type, message, count FROM pg_log_errors_stats() WHERE time_interval = 600;
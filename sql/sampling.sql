@@ -0,0 +1,23 @@
+ALTER SYSTEM SET logerrors.sample_threshold = 10;
+SELECT pg_reload_conf();
+SELECT pg_sleep(1);
+SELECT pg_log_errors_reset();
+SET client_min_messages = error;
+DO LANGUAGE plpgsql $$
+BEGIN
+    FOR i IN 1..1000 LOOP
+        RAISE WARNING USING ERRCODE = 'XX002', MESSAGE = 'logerrors sampling';
+    END LOOP;
+END;
+$$;
+RESET client_min_messages;
+SELECT pg_log_errors_advance_interval();
+-- Totals count every message
+SELECT type, message, count FROM pg_log_errors_stats() WHERE type = 'WARNING' AND message = 'TOTAL';
+-- Sampled counts are scaled back up and flagged
+SELECT type, count > 500 AND count <= 1000 AS close_to_total, estimated
+    FROM pg_log_errors_stats_filtered(filter_sqlstate => 'XX002') WHERE time_interval = 600;
+SELECT bool_or(estimated) FROM pg_log_errors_history(now() - interval '5 minutes') WHERE sqlstate = 'XX002';
+ALTER SYSTEM RESET logerrors.sample_threshold;
+SELECT pg_reload_conf();
+SELECT pg_sleep(1);
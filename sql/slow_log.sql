@@ -0,0 +1,14 @@
+-- The worker applies reset before slow statements are counted
+SELECT pg_log_errors_reset();
+SELECT pg_log_errors_advance_interval();
+SET log_min_duration_statement = 150;
+SET ROLE postgres;
+SELECT pg_sleep(0.3);
+SELECT pg_sleep(0.3);
+SELECT username, database, count, p50_ms >= 300 AND p99_ms < 60000 AS plausible FROM pg_slow_log_percentiles();
+SELECT username, sum(count), min(lower_bound_ms) <= 300 AND max(upper_bound_ms) >= 300 AS covers FROM pg_slow_log_histogram() GROUP BY username;
+SELECT slow_count FROM pg_slow_log_stats();
+-- Counted in pg_slow_log_stats(), but not in histograms
+DO $$ BEGIN RAISE WARNING 'elapsed duration: 5 ms'; END $$;
+SELECT slow_count FROM pg_slow_log_stats();
+SELECT sum(count) FROM pg_slow_log_histogram();
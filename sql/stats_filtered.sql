@@ -0,0 +1,22 @@
+SET ROLE postgres;
+SELECT pg_log_errors_reset();
+SELECT 1/0;
+DO LANGUAGE plpgsql $$
+BEGIN
+    RAISE WARNING USING ERRCODE = 'XX001', MESSAGE = 'logerrors stats filtered';
+END;
+$$;
+SELECT pg_log_errors_advance_interval();
+SELECT time_interval, type, message, count, sqlstate,
+       userid = (SELECT oid FROM pg_roles WHERE rolname = 'postgres') AS userid_matches,
+       dbid = (SELECT oid FROM pg_database WHERE datname = current_database()) AS dbid_matches
+    FROM pg_log_errors_stats_filtered(filter_type => 'error')
+    WHERE time_interval IS DISTINCT FROM 5;
+SELECT time_interval, type, message, count, username, database
+    FROM pg_log_errors_stats_filtered(filter_sqlstate => 'XX001')
+    WHERE time_interval = 600;
+SELECT count(*)
+    FROM pg_log_errors_stats_filtered(filter_dbid => (SELECT oid FROM pg_database WHERE datname = 'template1'));
+SELECT count(*) FROM pg_log_errors_stats_filtered(filter_type => 'notice');
+SELECT count(*) FROM pg_log_errors_stats_filtered(filter_sqlstate => '42p01');
+SELECT count(*) FROM pg_log_errors_stats_filtered(filter_sqlstate => '4260!');
@@ -0,0 +1,16 @@
+SET ROLE postgres;
+SELECT pg_log_errors_reset();
+DO LANGUAGE plpgsql $$
+BEGIN
+    FOR i IN 1..5 LOOP
+        RAISE WARNING 'logerrors top %', i;
+    END LOOP;
+END;
+$$;
+SELECT 1/0;
+SELECT pg_log_errors_advance_interval();
+-- Messages that differ only in numbers share a fingerprint
+SELECT type, count, error, sample LIKE 'logerrors top _' AS sample_matches
+    FROM pg_log_errors_top() WHERE type = 'WARNING';
+SELECT type, count FROM pg_log_errors_top(1);
+SELECT type, message, sqlstate, count, error, sample FROM pg_log_errors_top() WHERE type = 'ERROR';
@@ -0,0 +1,13 @@
+SET ROLE postgres;
+SELECT pg_log_errors_reset();
+SELECT 1/0;
+SELECT 1/0;
+DO LANGUAGE plpgsql $$
+BEGIN
+    RAISE WARNING USING ERRCODE = 'XX001', MESSAGE = 'logerrors window test';
+END;
+$$;
+SELECT pg_log_errors_advance_interval();
+-- Window maintained by the worker must match the window counted up from intervals
+SELECT pg_log_errors_verify_window();
+SELECT type, message, count, sqlstate FROM pg_log_errors_stats() WHERE time_interval = 600;
@@ -0,0 +1,79 @@
+#
+# pg_log_errors_backfill() on csvlog and jsonlog files put into log_directory:
+# quoted fields, escapes of jsonlog and lines with a time which can't be
+# parsed, which are skipped.
+#
+
+use strict;
+use warnings;
+use Test::More;
+
+BEGIN
+{
+	plan skip_all => 'PostgreSQL::Test::Cluster of PostgreSQL 15 or later is needed'
+	  unless eval { require PostgreSQL::Test::Cluster; 1 };
+}
+
+my $node = PostgreSQL::Test::Cluster->new('logerrors_backfill');
+# \u escapes of jsonlog are decoded to UTF-8
+$node->init(extra => [ '--encoding=UTF8', '--locale=C' ]);
+$node->append_conf('postgresql.conf', "shared_preload_libraries = 'logerrors'");
+$node->start;
+$node->safe_psql('postgres', 'CREATE EXTENSION logerrors');
+$node->safe_psql('postgres', "CREATE ROLE \"logerrors_\xc3\xbcser\"");
+
+my $log_directory =
+  $node->data_dir . '/' . $node->safe_psql('postgres', 'SHOW log_directory');
+mkdir $log_directory unless -d $log_directory;
+
+# Minutes before the start, so their buckets are free
+my ($utc1, $utc2) = split /\|/,
+  $node->safe_psql('postgres',
+	"SELECT to_char((date_trunc('minute', now()) - interval '10 minutes') AT TIME ZONE 'UTC', 'YYYY-MM-DD HH24:MI:SS.MS'),
+	        to_char((date_trunc('minute', now()) - interval '12 minutes') AT TIME ZONE 'UTC', 'YYYY-MM-DD HH24:MI:SS.MS')"
+  );
+my $time1 = "$utc1 UTC";
+my $time2 = "$utc2 UTC";
+
+sub write_log
+{
+	my ($name, $content) = @_;
+	open(my $file, '>:raw', "$log_directory/$name")
+	  or die "could not open $log_directory/$name: $!\n";
+	print $file $content;
+	close($file);
+	return;
+}
+
+write_log('backfill.csv', <<EOM);
+$time1,postgres,postgres,100,"[local]",1.1,1,SELECT,$time1,3/1,0,ERROR,22012,"division by zero",,,,,,"SELECT 1/0;",,,psql,client backend,,0
+$time2,postgres,postgres,100,"[local]",1.1,2,SELECT,$time2,3/2,0,ERROR,22012,"a ""quoted"", multiline
+message",,,,,,,,,psql,client backend,,0
+2024-13-45 25:00:00.000 UTC,postgres,postgres,100,"[local]",1.1,3,SELECT,,3/3,0,ERROR,22012,"malformed time",,,,,,,,,psql,client backend,,0
+$utc1 XYZT,postgres,postgres,100,"[local]",1.1,4,SELECT,,3/4,0,ERROR,22012,"unknown zone",,,,,,,,,psql,client backend,,0
+EOM
+
+write_log('backfill.json', <<'EOM' =~ s/TIME1/$time1/gr =~ s/TIME2/$time2/gr =~ s/UTC1/$utc1/gr);
+{"timestamp":"TIME1","user":"logerrors_\u00fcser","dbname":"postgres","pid":100,"error_severity":"WARNING","state_code":"01000","message":"a \"quoted\"\n message"}
+{"timestamp":"TIME2","user":"logerrors_\u00fcser","dbname":"postgres","pid":100,"error_severity":"WARNING","state_code":"01000","message":"tab\tand \\"}
+{"timestamp":"UTC1 XYZT","user":"postgres","dbname":"postgres","pid":100,"error_severity":"WARNING","state_code":"01000","message":"unknown zone"}
+EOM
+
+is( $node->safe_psql(
+		'postgres',
+		"SELECT pg_log_errors_backfill(now() - interval '30 minutes')"),
+	'4',
+	'lines with a malformed time are skipped');
+
+is( $node->safe_psql(
+		'postgres', "SELECT type, sqlstate, username, database, sum(count)
+		FROM pg_log_errors_history(now() - interval '30 minutes')
+		WHERE sqlstate IN ('22012', '01000')
+		GROUP BY type, sqlstate, username, database
+		ORDER BY type, sqlstate"),
+	"ERROR|22012|postgres|postgres|2\nWARNING|01000|logerrors_\xc3\xbcser|postgres|2",
+	'history has the backfilled messages with decoded names');
+
+$node->stop;
+
+done_testing();
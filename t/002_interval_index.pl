@@ -0,0 +1,89 @@
+#
+# Open-addressing tables of intervals and of the window with
+# logerrors.interval_slots of 16: kinds fill the index of an interval up to
+# its load limit, so probes collide and wrap around its end, and kinds of the
+# next interval are found again in the window.
+#
+
+use strict;
+use warnings;
+use Test::More;
+
+BEGIN
+{
+	plan skip_all => 'PostgreSQL::Test::Cluster of PostgreSQL 15 or later is needed'
+	  unless eval { require PostgreSQL::Test::Cluster; 1 };
+}
+
+my $node = PostgreSQL::Test::Cluster->new('logerrors_interval_index');
+$node->init;
+$node->append_conf(
+	'postgresql.conf', "shared_preload_libraries = 'logerrors'
+logerrors.manual_clock = on
+logerrors.interval_slots = 16");
+$node->start;
+$node->safe_psql(
+	'postgres', <<'EOM');
+CREATE EXTENSION logerrors;
+-- Codes Y0000, Y0001 and so on, each raised count times
+CREATE FUNCTION logerrors_raise(codes integer[], count integer)
+    RETURNS void LANGUAGE plpgsql AS $$
+DECLARE
+    code integer;
+BEGIN
+    FOREACH code IN ARRAY codes LOOP
+        FOR i IN 1 .. count LOOP
+            RAISE WARNING USING ERRCODE = 'Y' || lpad(code::text, 4, '0'),
+                MESSAGE = 'logerrors interval index';
+        END LOOP;
+    END LOOP;
+END
+$$;
+EOM
+
+sub raise_and_advance
+{
+	my ($codes, $count) = @_;
+	$node->safe_psql('postgres',
+		"SET client_min_messages = error; SELECT logerrors_raise('$codes', $count)");
+	$node->safe_psql('postgres', 'SELECT pg_log_errors_advance_interval()');
+	return;
+}
+
+# Kinds of the last interval (5) and of the window (600)
+sub kinds
+{
+	return $node->safe_psql(
+		'postgres', "SELECT time_interval, count(*), min(count), max(count)
+		FROM pg_log_errors_stats()
+		WHERE message <> 'TOTAL'
+		GROUP BY time_interval
+		ORDER BY time_interval");
+}
+
+$node->safe_psql('postgres', 'SELECT pg_log_errors_reset()');
+$node->safe_psql('postgres', 'SELECT pg_log_errors_advance_interval()');
+
+raise_and_advance('{0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15}', 1);
+is(kinds(), "5|16|1|1\n600|16|1|1", 'a full interval has every kind once');
+
+# Same kinds in another order, found again by their probes
+raise_and_advance('{15,14,13,12,11,10,9,8,7,6,5,4,3,2,1,0}', 2);
+is(kinds(), "5|16|2|2\n600|16|3|3", 'kinds are found again in the window');
+is( $node->safe_psql(
+		'postgres', "SELECT string_agg(sqlstate || '=' || count, ',' ORDER BY sqlstate)
+		FROM pg_log_errors_stats() WHERE time_interval = 600 AND sqlstate IN ('Y0000', 'Y0015')"),
+	'Y0000=3,Y0015=3',
+	'counts of the first and the last kind');
+is($node->safe_psql('postgres', 'SELECT pg_log_errors_verify_window()'),
+	't', 'window matches its intervals');
+
+# The first interval leaves the window
+$node->safe_psql('postgres', 'SELECT pg_log_errors_advance_interval(119)');
+is(kinds(), "600|16|2|2", 'kinds of the expired interval are subtracted');
+is($node->safe_psql('postgres', 'SELECT pg_log_errors_verify_window()'),
+	't', 'window matches its intervals after expiry');
+
+$node->stop;
+
+done_testing();
@@ -0,0 +1,90 @@
+#
+# OVERFLOW rows with logerrors.interval_slots of 16: kinds beyond the
+# capacity of an interval are counted by type only, in the interval and in
+# the window, so sum of counts of a type stays equal to its TOTAL.
+#
+
+use strict;
+use warnings;
+use Test::More;
+
+BEGIN
+{
+	plan skip_all => 'PostgreSQL::Test::Cluster of PostgreSQL 15 or later is needed'
+	  unless eval { require PostgreSQL::Test::Cluster; 1 };
+}
+
+my $node = PostgreSQL::Test::Cluster->new('logerrors_overflow');
+$node->init;
+$node->append_conf(
+	'postgresql.conf', "shared_preload_libraries = 'logerrors'
+logerrors.manual_clock = on
+logerrors.interval_slots = 16");
+$node->start;
+$node->safe_psql(
+	'postgres', <<'EOM');
+CREATE EXTENSION logerrors;
+-- Codes Y<first>, Y<first + 1> and so on up to Y<last>
+CREATE FUNCTION logerrors_raise(first integer, last integer)
+    RETURNS void LANGUAGE plpgsql AS $$
+BEGIN
+    FOR code IN first .. last LOOP
+        RAISE WARNING USING ERRCODE = 'Y' || lpad(code::text, 4, '0'),
+            MESSAGE = 'logerrors overflow';
+    END LOOP;
+END
+$$;
+EOM
+
+sub raise_and_advance
+{
+	my ($first, $last) = @_;
+	$node->safe_psql('postgres',
+		"SET client_min_messages = error; SELECT logerrors_raise($first, $last)");
+	$node->safe_psql('postgres', 'SELECT pg_log_errors_advance_interval()');
+	return;
+}
+
+# Count of kinds, OVERFLOW and sum of all counts of WARNING in the interval
+sub warnings_of
+{
+	my ($time_interval) = @_;
+	return $node->safe_psql(
+		'postgres', "SELECT count(*) FILTER (WHERE message <> 'OVERFLOW'),
+		       coalesce(sum(count) FILTER (WHERE message = 'OVERFLOW'), 0),
+		       sum(count)
+		FROM pg_log_errors_stats()
+		WHERE type = 'WARNING' AND time_interval = $time_interval");
+}
+
+sub warnings_total
+{
+	return $node->safe_psql('postgres',
+		"SELECT count FROM pg_log_errors_stats() WHERE type = 'WARNING' AND message = 'TOTAL'"
+	);
+}
+
+$node->safe_psql('postgres', 'SELECT pg_log_errors_reset()');
+$node->safe_psql('postgres', 'SELECT pg_log_errors_advance_interval()');
+
+# 20 kinds, the first 16 get slots in the order they came
+raise_and_advance(0, 19);
+is(warnings_of(5), '16|4|20', 'kinds beyond capacity of the interval are OVERFLOW');
+is(warnings_of(600), '16|4|20', 'the window counts them as OVERFLOW too');
+is( $node->safe_psql(
+		'postgres',
+		"SELECT max(sqlstate) FROM pg_log_errors_stats() WHERE time_interval = 5"),
+	'Y0015',
+	'kinds which came first have slots');
+
+# Kinds which overflowed get slots of the next interval, the window has room for them
+raise_and_advance(16, 19);
+is(warnings_of(5), '4|0|4', 'the next interval has no OVERFLOW');
+is(warnings_of(600), '20|4|24', 'the window keeps OVERFLOW of the first interval');
+is(warnings_total(), '24', 'sum of counts of the window is TOTAL');
+is($node->safe_psql('postgres', 'SELECT pg_log_errors_verify_window()'),
+	't', 'window matches its intervals');
+
+$node->stop;
+
+done_testing();
@@ -0,0 +1,93 @@
+#
+# Per-backend counters merged by the worker: concurrent clients count
+# messages in counters of their own PGPROC slots, the worker adds them to
+# the interval on its tick, also of backends which have exited by then.
+#
+
+use strict;
+use warnings;
+use Test::More;
+
+BEGIN
+{
+	plan skip_all => 'PostgreSQL::Test::Cluster of PostgreSQL 15 or later is needed'
+	  unless eval { require PostgreSQL::Test::Cluster; 1 };
+}
+
+my $clients = 4;
+my $transactions = 5;
+
+my $node = PostgreSQL::Test::Cluster->new('logerrors_backend_counters');
+$node->init;
+$node->append_conf(
+	'postgresql.conf', "shared_preload_libraries = 'logerrors'
+logerrors.manual_clock = on");
+$node->start;
+$node->safe_psql('postgres', 'CREATE EXTENSION logerrors');
+
+my $script = $node->basedir . '/raise.sql';
+open(my $file, '>', $script) or die "could not open $script: $!\n";
+print $file <<'EOM';
+DO $$
+BEGIN
+    FOR i IN 1 .. 3 LOOP
+        RAISE WARNING USING ERRCODE = 'Y0001', MESSAGE = 'logerrors backend counters';
+    END LOOP;
+    RAISE WARNING USING ERRCODE = 'Y0002', MESSAGE = 'logerrors backend counters';
+END
+$$;
+EOM
+close($file);
+
+sub pgbench_raise
+{
+	my ($name) = @_;
+	# Messages are logged, but not sent to the clients
+	local $ENV{PGOPTIONS} = '-c client_min_messages=error';
+	$node->command_ok(
+		[
+			'pgbench', '-n', '-c', $clients, '-j', $clients, '-t', $transactions,
+			'-f', $script, 'postgres'
+		],
+		$name);
+	return;
+}
+
+sub counts
+{
+	my ($time_interval) = @_;
+	return $node->safe_psql(
+		'postgres', "SELECT string_agg(sqlstate || '=' || count, ',' ORDER BY sqlstate)
+		FROM pg_log_errors_stats()
+		WHERE type = 'WARNING' AND time_interval = $time_interval");
+}
+
+$node->safe_psql('postgres', 'SELECT pg_log_errors_reset()');
+$node->safe_psql('postgres', 'SELECT pg_log_errors_advance_interval()');
+
+# Clients have exited before the tick
+pgbench_raise('clients raise warnings');
+is(counts(5), '', 'messages stay in backend counters until the tick');
+$node->safe_psql('postgres', 'SELECT pg_log_errors_advance_interval()');
+is( counts(5),
+	'Y0001=' . ($clients * $transactions * 3) . ',Y0002=' . ($clients * $transactions),
+	'the worker merges counters of all clients');
+is( $node->safe_psql(
+		'postgres',
+		"SELECT count FROM pg_log_errors_stats() WHERE type = 'WARNING' AND message = 'TOTAL'"),
+	$clients * $transactions * 4,
+	'TOTAL sums counters of all backends');
+
+# New clients may take the same slots, nothing is counted twice
+pgbench_raise('clients raise warnings again');
+$node->safe_psql('postgres', 'SELECT pg_log_errors_advance_interval()');
+is( counts(5),
+	'Y0001=' . ($clients * $transactions * 3) . ',Y0002=' . ($clients * $transactions),
+	'the next interval has only new messages');
+is( counts(600),
+	'Y0001=' . ($clients * $transactions * 6) . ',Y0002=' . ($clients * $transactions * 2),
+	'the window has messages of both intervals');
+
+$node->stop;
+
+done_testing();
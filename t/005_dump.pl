@@ -0,0 +1,84 @@
+#
+# Statistics saved on shutdown and loaded on start: they survive a restart
+# unchanged, and a file with a wrong CRC32C is ignored as a whole.
+#
+
+use strict;
+use warnings;
+use Test::More;
+
+BEGIN
+{
+	plan skip_all => 'PostgreSQL::Test::Cluster of PostgreSQL 15 or later is needed'
+	  unless eval { require PostgreSQL::Test::Cluster; 1 };
+}
+
+my $node = PostgreSQL::Test::Cluster->new('logerrors_dump');
+$node->init;
+$node->append_conf(
+	'postgresql.conf', "shared_preload_libraries = 'logerrors'
+logerrors.manual_clock = on");
+$node->start;
+$node->safe_psql('postgres', 'CREATE EXTENSION logerrors');
+
+my $dump_file = $node->data_dir . '/pg_stat/logerrors.stat';
+my $stats_query = 'SELECT * FROM pg_log_errors_stats()
+	ORDER BY time_interval NULLS FIRST, type, sqlstate';
+my $counters_query = 'SELECT type, message, sqlstate, count FROM pg_log_errors_counters()
+	ORDER BY type, sqlstate';
+
+$node->safe_psql('postgres', 'SELECT pg_log_errors_reset()');
+$node->safe_psql('postgres', 'SELECT pg_log_errors_advance_interval()');
+$node->safe_psql(
+	'postgres', <<'EOM');
+SET client_min_messages = error;
+DO $$
+BEGIN
+    FOR i IN 1 .. 3 LOOP
+        RAISE WARNING USING ERRCODE = 'Y0001', MESSAGE = 'logerrors dump';
+    END LOOP;
+END
+$$;
+EOM
+$node->psql('postgres', 'SELECT 1/0');
+$node->safe_psql('postgres', 'SELECT pg_log_errors_advance_interval()');
+
+my $stats = $node->safe_psql('postgres', $stats_query);
+my $counters = $node->safe_psql('postgres', $counters_query);
+like($stats, qr/^5\|ERROR\|ERRCODE_DIVISION_BY_ZERO\|1\|/m, 'the interval has the error');
+
+$node->restart;
+is($node->safe_psql('postgres', $stats_query), $stats, 'intervals and totals are loaded');
+is($node->safe_psql('postgres', $counters_query), $counters, 'counters are loaded');
+ok(!-e $dump_file, 'the file is removed once loaded');
+
+# A flipped byte of the CRC
+$node->stop;
+ok(-e $dump_file, 'statistics are saved on shutdown');
+open(my $file, '+<:raw', $dump_file) or die "could not open $dump_file: $!\n";
+my $size = -s $dump_file;
+my $byte;
+seek($file, $size - 1, 0);
+read($file, $byte, 1);
+seek($file, $size - 1, 0);
+print $file chr(ord($byte) ^ 0xFF);
+close($file);
+
+my $log_offset = -s $node->logfile;
+$node->start;
+like(
+	substr(PostgreSQL::Test::Utils::slurp_file($node->logfile), $log_offset),
+	qr/ignoring invalid data in file "pg_stat\/logerrors.stat"/,
+	'the file with a wrong CRC is reported');
+is( $node->safe_psql(
+		'postgres', "SELECT sum(count), count(*) FILTER (WHERE message <> 'TOTAL')
+		FROM pg_log_errors_stats()"),
+	'0|0',
+	'nothing of the file is loaded');
+is($node->safe_psql('postgres', 'SELECT count(*) FROM pg_log_errors_counters()'),
+	'0', 'counters are not loaded');
+ok(!-e $dump_file, 'the invalid file is removed');
+
+$node->stop;
+
+done_testing();
@@ -0,0 +1,60 @@
+#
+# Intervals closed by the timer of the worker without logerrors.manual_clock:
+# a message comes to the window only when the interval it was counted in
+# closes, ticks and sequences of intervals grow on their own.
+#
+
+use strict;
+use warnings;
+use Test::More;
+
+BEGIN
+{
+	plan skip_all => 'PostgreSQL::Test::Cluster of PostgreSQL 15 or later is needed'
+	  unless eval { require PostgreSQL::Test::Cluster; 1 };
+}
+
+my $node = PostgreSQL::Test::Cluster->new('logerrors_timer');
+$node->init;
+$node->append_conf(
+	'postgresql.conf', "shared_preload_libraries = 'logerrors'
+logerrors.interval = '1s'");
+$node->start;
+$node->safe_psql('postgres', 'CREATE EXTENSION logerrors');
+
+my ($ret, $stdout, $stderr) =
+  $node->psql('postgres', 'SELECT pg_log_errors_advance_interval()');
+like(
+	$stderr,
+	qr/logerrors intervals are advanced only with logerrors.manual_clock/,
+	'intervals are not advanced by hand');
+
+my $ticks = $node->safe_psql('postgres', 'SELECT ticks FROM pg_log_errors_internal_stats()');
+my $high_water =
+  $node->safe_psql('postgres', 'SELECT max(high_water) FROM pg_log_errors_changes()');
+$node->psql('postgres', 'SELECT 1/0');
+
+# The window of 120 intervals of 1s keeps the message long enough to be seen
+ok( $node->poll_query_until(
+		'postgres', "SELECT count FROM pg_log_errors_stats()
+		WHERE time_interval = 120 AND message = 'ERRCODE_DIVISION_BY_ZERO'",
+		'1'),
+	'the worker closes the interval with the message on its own');
+ok( $node->poll_query_until(
+		'postgres',
+		"SELECT ticks >= $ticks + 2 FROM pg_log_errors_internal_stats()"),
+	'the worker ticks every interval');
+ok( $node->poll_query_until(
+		'postgres',
+		"SELECT max(high_water) >= $high_water + 2 FROM pg_log_errors_changes($high_water)"
+	),
+	'closed intervals get sequences');
+is( $node->safe_psql(
+		'postgres', "SELECT sum(count) FROM pg_log_errors_changes($high_water)
+		WHERE message = 'ERRCODE_DIVISION_BY_ZERO'"),
+	'1',
+	'the message is in one of the closed intervals');
+
+$node->stop;
+
+done_testing();